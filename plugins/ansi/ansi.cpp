@@ -50,6 +50,16 @@ QString color(QColor color, int alpha_threshold,
             return sgr(codes);
         }
 
+        if ( mode == ColorMode::XTerm256 )
+        {
+            int index = misc::color::toXterm256(color.rgb());
+            if ( background )
+                codes += QList<int>{48, 5, index};
+            if ( foreground )
+                codes += QList<int>{38, 5, index};
+            return sgr(codes);
+        }
+
         color_int = misc::color::to4bit(color);
 
         if ( mode == ColorMode::Standard )
@@ -76,4 +86,139 @@ QString color(QColor color, int alpha_threshold,
     return sgr(codes);
 }
 
+void ImageWriter::mapRow(const QRgb* row, int count, std::vector<uchar>& indices) const
+{
+    indices.resize(count);
+    if ( mode == ColorMode::XTerm256 )
+        misc::color::toXterm256(row, count, indices.data());
+    else if ( mode != ColorMode::Rgb )
+        misc::color::to4bit(row, count, indices.data());
+}
+
+QByteArray ImageWriter::code(QRgb color, int index, bool foreground, bool background)
+{
+    // Transparent colors all result in the default code,
+    // opaque ones have the alpha bits set so they can't clash with indices
+    quint64 value = color;
+    if ( qAlpha(color) <= alpha_threshold )
+        value = 0x100;
+    else if ( mode != ColorMode::Rgb )
+        value = index;
+
+    quint64 key = value | quint64(foreground) << 32 | quint64(background) << 33;
+    auto it = codes.find(key);
+    if ( it == codes.end() )
+    {
+        QString sgr = ansi::color(QColor::fromRgba(color), alpha_threshold,
+                                  foreground, background, mode);
+        it = codes.insert(key, sgr.toLatin1());
+    }
+    return *it;
+}
+
+void ImageWriter::write(const QImage& image, QIODevice* device, const QString& pixel)
+{
+    QImage argb = image.convertToFormat(QImage::Format_ARGB32);
+    QByteArray pixel_text = pixel.toUtf8();
+    QByteArray clear = sgrClear().toLatin1();
+    QByteArray line;
+    std::vector<uchar> indices;
+
+    for ( int y = 0; y < argb.height(); y++ )
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+        QByteArray last;
+        line.clear();
+        mapRow(row, argb.width(), indices);
+        for ( int x = 0; x < argb.width(); x++ )
+        {
+            QByteArray sgr = code(row[x], indices[x], true, true);
+            if ( sgr != last )
+            {
+                line += sgr;
+                last = sgr;
+            }
+            line += pixel_text;
+        }
+        // Resetting avoids the background bleeding past the end of the line
+        if ( !last.isEmpty() )
+            line += clear;
+        line += '\n';
+        device->write(line);
+    }
+}
+
+void ImageWriter::writeHalfBlocks(const QImage& image, QIODevice* device)
+{
+    QImage argb = image.convertToFormat(QImage::Format_ARGB32);
+    QByteArray upper_half("\xe2\x96\x80");
+    QByteArray lower_half("\xe2\x96\x84");
+    QByteArray clear = sgrClear().toLatin1();
+    QByteArray line;
+    std::vector<uchar> top_indices;
+    std::vector<uchar> bottom_indices(argb.width(), 0);
+
+    for ( int y = 0; y < argb.height(); y += 2 )
+    {
+        const QRgb* top = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+        const QRgb* bottom = y + 1 < argb.height() ?
+            reinterpret_cast<const QRgb*>(argb.constScanLine(y + 1)) : nullptr;
+        QByteArray last_foreground;
+        QByteArray last_background;
+        line.clear();
+        mapRow(top, argb.width(), top_indices);
+        if ( bottom )
+            mapRow(bottom, argb.width(), bottom_indices);
+
+        for ( int x = 0; x < argb.width(); x++ )
+        {
+            QRgb top_color = top[x];
+            QRgb bottom_color = bottom ? bottom[x] : 0;
+            bool top_visible = qAlpha(top_color) > alpha_threshold;
+            bool bottom_visible = qAlpha(bottom_color) > alpha_threshold;
+
+            // The visible half is drawn with the foreground color
+            QByteArray glyph = upper_half;
+            QRgb foreground = top_color;
+            int foreground_index = top_indices[x];
+            QRgb background = bottom_visible ? bottom_color : 0;
+            int background_index = bottom_indices[x];
+            if ( !top_visible )
+            {
+                glyph = bottom_visible ? lower_half : QByteArray(" ");
+                foreground = bottom_color;
+                foreground_index = bottom_indices[x];
+                background = 0;
+            }
+
+            QByteArray sgr = code(background, background_index, false, true);
+            if ( sgr != last_background )
+            {
+                line += sgr;
+                last_background = sgr;
+                // Standard codes set the brightness along with the background
+                if ( mode == ColorMode::Standard )
+                    last_foreground.clear();
+            }
+
+            if ( top_visible || bottom_visible )
+            {
+                sgr = code(foreground, foreground_index, true, false);
+                if ( sgr != last_foreground )
+                {
+                    line += sgr;
+                    last_foreground = sgr;
+                }
+            }
+
+            line += glyph;
+        }
+
+        if ( !last_background.isEmpty() )
+            line += clear;
+        line += '\n';
+        device->write(line);
+    }
+}
+
 } // namespace ansi
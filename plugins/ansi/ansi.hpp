@@ -20,6 +20,10 @@
  */
 #ifndef PIXEl_CAYMAN_PLUGIN_ANSI_HPP
 #define PIXEl_CAYMAN_PLUGIN_ANSI_HPP
+#include <vector>
+#include <QHash>
+#include <QImage>
+#include <QIODevice>
 #include <QStringList>
 #include "misc/color.hpp"
 namespace ansi {
@@ -67,6 +71,7 @@ enum class ColorMode
 {
     Standard, ///< Standard ANSI code (8 colors + bold)
     XTerm,    ///< Standard for dark colors, special codes for bright
+    XTerm256, ///< 256 color palette
     Rgb       ///< Full 24 bit color support
 };
 
@@ -82,5 +87,45 @@ QString color(QColor color, int alpha_threshold = 32,
               bool foreground = true, bool background = true,
               ColorMode mode = ColorMode::Standard);
 
+/**
+ * \brief Writes images as ANSI-colored text
+ *
+ * The code for each color is computed once and emitted only when it
+ * differs from the one currently active.
+ */
+class ImageWriter
+{
+public:
+    explicit ImageWriter(ColorMode mode = ColorMode::Standard, int alpha_threshold = 32)
+        : mode(mode), alpha_threshold(alpha_threshold)
+    {}
+
+    /**
+     * \brief Writes each pixel as \p pixel colored in both foreground and background
+     */
+    void write(const QImage& image, QIODevice* device, const QString& pixel);
+
+    /**
+     * \brief Writes two rows of pixels per line using half block characters
+     */
+    void writeHalfBlocks(const QImage& image, QIODevice* device);
+
+private:
+    /**
+     * \brief Maps a row of pixels to palette indices, if the mode uses a palette
+     */
+    void mapRow(const QRgb* row, int count, std::vector<uchar>& indices) const;
+
+    /**
+     * \brief Cached result of color()
+     * \param index Palette index of \p color as given by mapRow()
+     */
+    QByteArray code(QRgb color, int index, bool foreground, bool background);
+
+    ColorMode mode;
+    int alpha_threshold;
+    QHash<quint64, QByteArray> codes;
+};
+
 } // namespace ansi
 #endif // PIXEl_CAYMAN_PLUGIN_ANSI_HPP
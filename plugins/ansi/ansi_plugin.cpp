@@ -19,8 +19,6 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
-#include <QTextStream>
-
 #include "plugin.hpp"
 #include "io/bitmap.hpp"
 #include "ansi.hpp"
@@ -54,17 +52,23 @@ public:
     bool saveImage(const QImage& img, QIODevice* device,
                    const ::document::Document* document) override
     {
-        /// \todo Read pixel string, newline and ANSI options from config
-        QTextStream stream(device);
+        /// \todo Read the newline from config
         device->setTextModeEnabled(true);
-        QString pixel = "..";
-        for ( int y = 0; y < img.height(); y++ )
-        {
-            for ( int x = 0; x < img.width(); x++ )
-                stream << ansi::color(img.pixel(x, y)) << pixel;
-            stream << '\n';
-        }
-        stream << ansi::sgrClear();
+
+        QString color_mode = setting<QString>("color_mode", document, "standard");
+        ansi::ColorMode mode = ansi::ColorMode::Standard;
+        if ( color_mode == "xterm" )
+            mode = ansi::ColorMode::XTerm;
+        else if ( color_mode == "xterm256" )
+            mode = ansi::ColorMode::XTerm256;
+        else if ( color_mode == "rgb" )
+            mode = ansi::ColorMode::Rgb;
+
+        ansi::ImageWriter writer(mode);
+        if ( setting("half_block", document, false) )
+            writer.writeHalfBlocks(img, device);
+        else
+            writer.write(img, device, setting<QString>("pixel", document, ".."));
         return true;
     }
 
@@ -0,0 +1,249 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "color_parser.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "misc/color.hpp"
+
+namespace ansi {
+
+namespace {
+
+/**
+ * \brief Color with the same hue and saturation but full value
+ */
+QRgb brighten(QRgb color)
+{
+    QColor base = QColor::fromRgba(color);
+    return QColor::fromHsv(base.hsvHue(), base.hsvSaturation(), 255, base.alpha()).rgba();
+}
+
+} // namespace
+
+QImage ColorParser::image() const
+{
+    QImage img(size(), QImage::Format_ARGB32);
+    if ( img.isNull() )
+        return img;
+
+    uchar* bits = img.bits();
+    int bytes_per_line = img.bytesPerLine();
+    for ( std::size_t row = 0; row < line_starts.size(); row++ )
+    {
+        int begin = line_starts[row];
+        int end = row + 1 < line_starts.size() ? line_starts[row+1] : int(pixels.size());
+        uchar* first = bits + row * pixel_height * bytes_per_line;
+
+        QRgb* line = reinterpret_cast<QRgb*>(first);
+        std::memcpy(line, pixels.data() + begin, (end - begin) * sizeof(QRgb));
+        std::fill(line + (end - begin), line + max_w, background_color);
+
+        for ( int i = 1; i < pixel_height; i++ )
+            std::memcpy(first + i * bytes_per_line, first, max_w * sizeof(QRgb));
+    }
+    return img;
+}
+
+void ColorParser::parse(const QByteArray& data)
+{
+    const char* begin = data.constData();
+    const char* end = begin + data.size();
+    pixels.reserve(data.size());
+    pushLine();
+
+    for ( const char* it = begin; it < end; )
+    {
+        uchar ch = *it++;
+        if ( ch == '\x1b' )
+        {
+            it = parseCode(it, end);
+        }
+        else if ( ch == '\n' )
+        {
+            pushLine();
+        }
+        else if ( ch == ' ' || ch == '\t' || ch == '\v' || ch == '\f' ||
+                  (ch == '\r' && (it == end || *it != '\n')) )
+        {
+            pixels.push_back(option == Option::Foreground ? background_color : pixel);
+        }
+        // Skip control characters and UTF-8 continuation bytes
+        else if ( ch >= 0x20 && ch != 0x7f && (ch & 0xc0) != 0x80 )
+        {
+            pixels.push_back(pixel);
+        }
+    }
+
+    max_w = std::max(max_w, int(pixels.size()) - line_starts.back());
+    if ( line_starts.back() == int(pixels.size()) )
+        line_starts.pop_back();
+}
+
+void ColorParser::pushLine()
+{
+    if ( !line_starts.empty() )
+        max_w = std::max(max_w, int(pixels.size()) - line_starts.back());
+    line_starts.push_back(pixels.size());
+}
+
+const char* ColorParser::parseCode(const char* begin, const char* end)
+{
+    if ( begin == end )
+        return end;
+    if ( *begin != '[' )
+        return begin + 1;
+
+    const int max_args = 32;
+    int args[max_args];
+    int count = 0;
+    int value = 0;
+
+    for ( const char* it = begin + 1; it < end; ++it )
+    {
+        uchar ch = *it;
+        if ( ch >= '0' && ch <= '9' )
+        {
+            value = std::min(value * 10 + (ch - '0'), 0xffff);
+        }
+        else if ( ch == ';' || ch == ':' )
+        {
+            if ( count < max_args )
+                args[count++] = value;
+            value = 0;
+        }
+        else if ( ch >= 0x40 && ch <= 0x7e )
+        {
+            if ( count < max_args )
+                args[count++] = value;
+            if ( ch == 'm' )
+                parseSgr(args, count);
+            return it + 1;
+        }
+        else if ( ch < 0x20 )
+        {
+            // Unterminated sequence, the control character is parsed as text
+            return it;
+        }
+    }
+
+    return end;
+}
+
+void ColorParser::parseSgr(const int* args, int count)
+{
+    for ( int i = 0; i < count; i++ )
+    {
+        int arg = args[i];
+        if ( arg == 0 )
+            clearFormat();
+        else if ( arg == 1 )
+            bold = true;
+        else if ( arg == 2 || arg == 21 || arg == 22 )
+            bold = false;
+        else if ( arg == 7 )
+            swapped = true;
+        else if ( arg == 8 )
+            color &= 0x00ffffff;
+        else if ( arg == 27 )
+            swapped = false;
+        else if ( arg == 28 )
+            color |= 0xff000000;
+        else if ( arg >= 30 && arg <= 37 && foreground() )
+            set8Color(arg);
+        else if ( arg == 38 )
+            setExtendedColor(i, args, count);
+        else if ( arg == 39 && foreground() )
+            color = 0;
+        else if ( arg >= 40 && arg <= 47 && background() )
+            set8Color(arg);
+        else if ( arg == 48 )
+            setExtendedColor(i, args, count);
+        else if ( arg == 49 && background() )
+            color = 0;
+        else if ( arg >= 90 && arg <= 97 && foreground() )
+            set8Color(arg);
+        else if ( arg >= 100 && arg <= 107 && background() )
+            set8Color(arg);
+    }
+
+    updatePixel();
+}
+
+void ColorParser::set8Color(int value)
+{
+    follow_bold = true;
+
+    switch ( value % 10 )
+    {
+        case 0: color = QColor(Qt::black).rgba(); break;
+        case 1: color = QColor(Qt::darkRed).rgba(); break;
+        case 2: color = QColor(Qt::darkGreen).rgba(); break;
+        case 3: color = QColor(Qt::darkYellow).rgba(); break;
+        case 4: color = QColor(Qt::darkBlue).rgba(); break;
+        case 5: color = QColor(Qt::darkMagenta).rgba(); break;
+        case 6: color = QColor(Qt::darkCyan).rgba(); break;
+        case 7: color = QColor(Qt::gray).rgba(); break;
+    }
+}
+
+void ColorParser::setExtendedColor(int& i, const int* args, int count)
+{
+    bool apply = args[i] == 38 ? foreground() : background();
+    int j = i + 1;
+
+    if ( j < count && args[j] == 5 )
+    {
+        i += 2;
+        if ( i >= count || !apply )
+            return;
+
+        int index = args[i];
+        if ( index < 16 )
+        {
+            set8Color(index & 7);
+            if ( index & 8 )
+                color = brighten(color);
+            follow_bold = false;
+        }
+        else if ( index < 256 )
+        {
+            color = misc::color::fromXterm256(index);
+            follow_bold = false;
+        }
+        return;
+    }
+
+    i += 4;
+    if ( i >= count || args[j] != 2 || !apply )
+        return;
+    color = qRgb(args[j+1] & 0xff, args[j+2] & 0xff, args[j+3] & 0xff);
+    follow_bold = false;
+}
+
+void ColorParser::updatePixel()
+{
+    pixel = follow_bold && bold ? brighten(color) : color;
+}
+
+} // namespace ansi
@@ -20,14 +20,18 @@
  */
 #ifndef PIXEL_CAYMAN_PLUGINS_ANSI_COLOR_PARSER_HPP
 #define PIXEL_CAYMAN_PLUGINS_ANSI_COLOR_PARSER_HPP
+#include <vector>
 #include <QImage>
 #include <QColor>
-#include <QTextStream>
+#include <QIODevice>
 
 namespace ansi {
 
 /**
  * \brief Parses colors from ansi-formatted text
+ *
+ * The whole input is read in a buffer and scanned byte by byte,
+ * each character of the text results in a pixel.
  */
 class ColorParser
 {
@@ -53,14 +57,12 @@ public:
                          Option option,
                          int pixel_height = 2,
                          QColor background_color = Qt::transparent)
-        : stream(device),
-         option(option),
+        : option(option),
          pixel_height(pixel_height),
-         background_color(background_color)
+         background_color(background_color.rgba())
     {
         device->setTextModeEnabled(true);
-        stream.setIntegerBase(10);
-        parse();
+        parse(device->readAll());
     }
 
     /**
@@ -68,161 +70,44 @@ public:
      */
     QSize size() const
     {
-        return {max_w, pixels.size()*pixel_height};
+        return {max_w, int(line_starts.size()) * pixel_height};
     }
 
     /**
      * \brief Builds an image from the parsed data
      */
-    QImage image() const
-    {
-        QImage img(size(), QImage::Format_ARGB32);
-        img.fill(background_color);
-        for ( int y = 0; y < pixels.size(); y++ )
-            for ( int i = 0; i < pixel_height; i++ )
-                for ( int x = 0; x < pixels[y].size(); x++ )
-                    img.setPixel(x, y*pixel_height+i, pixels[y][x].rgba());
-        return img;
-    }
+    QImage image() const;
 
 private:
     /**
-     * \brief Push the current color
+     * \brief Parse the input data
      */
-    void pushPrintable()
-    {
-        if ( follow_bold && bold )
-        {
-            pixels.back().push_back(
-                QColor::fromHsv(color.hsvHue(), color.hsvSaturation(), 255, color.alpha())
-            );
-        }
-        else
-        {
-            pixels.back().push_back(color);
-        }
-    }
-    /**
-     * \brief Push the current color or the background
-     */
-    void pushSpace()
-    {
-        if ( option == Option::Foreground )
-            pixels.back().push_back(background_color);
-        else
-            pushPrintable();
-    }
+    void parse(const QByteArray& data);
 
     /**
-     * \brief Add a new line of pixels
-     */
-    void pushLine()
-    {
-        if ( !pixels.empty() && pixels.back().size() > max_w )
-            max_w = pixels.back().size();
-
-        QVector<QColor> line;
-        line.reserve(max_w);
-        pixels.push_back(line);
-    }
-
-    /**
-     * \brief Parse the input device
+     * \brief Parse an escape sequence
+     * \param begin Character after the escape
+     * \param end   End of the input
+     * \return Character after the sequence
      */
-    void parse()
-    {
-        while ( !stream.status() )
-            parseLine();
-
-        if ( pixels.back().empty() )
-            pixels.pop_back();
-    }
+    const char* parseCode(const char* begin, const char* end);
 
     /**
-     * \brief Parse a line of text
+     * \brief Apply the arguments of a Select Graphic Rendition code
      */
-    void parseLine()
-    {
-        pushLine();
-        QChar ch;
-        while ( !stream.status() )
-        {
-            stream >> ch;
-            if ( ch == '\x1b' )
-                parseCode();
-            else if ( ch == '\n' )
-                break;
-            else if ( ch.isSpace() )
-                pushSpace();
-            else if ( ch.isPrint() )
-                pushPrintable();
-        }
-    }
+    void parseSgr(const int* args, int count);
 
     /**
-     * \brief Parse an ANSI code
+     * \brief Add a new line of pixels
      */
-    void parseCode()
-    {
-        QChar ch;
-        stream >> ch;
-        if ( ch != '[' )
-            return;
-
-        QList<int> args;
-        do
-        {
-            int arg;
-            stream >> arg >> ch;
-            args.push_back(arg);
-        }
-        while ( !stream.status() && ch != 'm' && ch != '\n' );
-
-        if ( ch != 'm' )
-            return;
-
-        for ( int i = 0; i < args.size(); i++ )
-        {
-            int arg = args[i];
-            if ( arg == 0 )
-                clearFormat();
-            else if ( arg == 1 )
-                bold = true;
-            else if ( arg == 2 || arg == 21 || arg == 22 )
-                bold = false;
-            else if ( arg == 7 )
-                swapped = true;
-            else if ( arg == 8 )
-                color.setAlpha(0);
-            else if ( arg == 27 )
-                swapped = false;
-            else if ( arg == 28 )
-                color.setAlpha(255);
-            else if ( arg >= 30 && arg <= 37 && foreground() )
-                set8Color(arg);
-            else if ( arg == 38 && foreground() )
-                set24bitColor(i, args);
-            else if ( arg == 39 && foreground() )
-                color = Qt::transparent;
-            else if ( arg >= 40 && arg <= 47 && background() )
-                set8Color(arg);
-            else if ( arg == 48 && background() )
-                set24bitColor(i, args);
-            else if ( arg == 49 && background() )
-                color = Qt::transparent;
-            else if ( arg >= 90 && arg <= 97 && foreground() )
-                set8Color(arg);
-            else if ( arg >= 100 && arg <= 107 && background() )
-                set8Color(arg);
-        }
-    }
+    void pushLine();
 
     /**
      * \brief Reset to the default
      */
     void clearFormat()
     {
-        color = Qt::transparent;
+        color = 0;
         bold = false;
         swapped = false;
         follow_bold = true;
@@ -231,7 +116,7 @@ private:
     /**
      * \brief Whether should get the color from the background codes
      */
-    bool background()
+    bool background() const
     {
         return (option == Option::Background) ^ swapped;
     }
@@ -239,7 +124,7 @@ private:
     /**
      * \brief Whether should get the color from the foreground codes
      */
-    bool foreground()
+    bool foreground() const
     {
         return !background();
     }
@@ -247,46 +132,29 @@ private:
     /**
      * \brief Set an indexed/3bit color
      */
-    void set8Color(int value)
-    {
-        follow_bold = true;
+    void set8Color(int value);
 
-        switch ( value % 10 )
-        {
-            case 0: color = Qt::black; break;
-            case 1: color = Qt::darkRed; break;
-            case 2: color = Qt::darkGreen; break;
-            case 3: color = Qt::darkYellow; break;
-            case 4: color = Qt::darkBlue; break;
-            case 5: color = Qt::darkMagenta; break;
-            case 6: color = Qt::darkCyan; break;
-            case 7: color = Qt::gray; break;
-        }
-    }
+    /**
+     * \brief Set a 24 bit or a 256 color palette color
+     */
+    void setExtendedColor(int& i, const int* args, int count);
 
     /**
-     * \brief Set a 24 bit color
+     * \brief Updates the color used for printable characters
      */
-    void set24bitColor(int& i, const QList<int>& args)
-    {
-        int j = i+1;
-        i += 4;
-        if ( i >= args.size() || args[j] != 2 )
-            return;
-        color = QColor(args[j+1], args[j+2], args[j+3]);
-        follow_bold = false;
-    }
+    void updatePixel();
 
-    QVector<QVector<QColor>> pixels;
-    QColor color;
+    std::vector<QRgb> pixels;       ///< Pixels of all the lines
+    std::vector<int> line_starts;   ///< Index in pixels where each line begins
+    QRgb color = 0xff000000;        ///< Color set by the codes
+    QRgb pixel = 0xff000000;        ///< Color with bold applied
     int max_w = 0;
-    QTextStream stream;
     Option option;
     bool bold = false;
     bool swapped = false;
     bool follow_bold = true;
     int pixel_height = 2;
-    QColor background_color;
+    QRgb background_color;
 };
 
 } // namespace ansi
@@ -24,15 +24,65 @@
 #include <QMimeDatabase>
 #include <QImageWriter>
 #include <QBuffer>
+#include <QThread>
+#include <QtConcurrent>
 
 #include "io/formats.hpp"
+#include "document/visitor.hpp"
 #include "plugin.hpp"
 #include "external_tools/external_tools.hpp"
 #include "plugin/library_plugin.hpp"
 
 static QMimeType mime_type = QMimeDatabase().mimeTypeForName("image/png");
+
+/**
+ * \brief Name of the feBlend mode matching \p mode, empty if there is none
+ */
+static QString blendModeName(QPainter::CompositionMode mode)
+{
+    switch ( mode )
+    {
+        case QPainter::CompositionMode_Multiply:    return "multiply";
+        case QPainter::CompositionMode_Screen:      return "screen";
+        case QPainter::CompositionMode_Overlay:     return "overlay";
+        case QPainter::CompositionMode_Darken:      return "darken";
+        case QPainter::CompositionMode_Lighten:     return "lighten";
+        case QPainter::CompositionMode_ColorDodge:  return "color-dodge";
+        case QPainter::CompositionMode_ColorBurn:   return "color-burn";
+        case QPainter::CompositionMode_HardLight:   return "hard-light";
+        case QPainter::CompositionMode_SoftLight:   return "soft-light";
+        case QPainter::CompositionMode_Difference:  return "difference";
+        case QPainter::CompositionMode_Exclusion:   return "exclusion";
+        default:                                    return QString();
+    }
+}
+
+/**
+ * \brief Encodes an image as a base64 data URI
+ */
+static QString dataUri(const QImage& image)
+{
+    QByteArray image_data;
+    {
+        QBuffer buffer(&image_data);
+        QImageWriter image_writer(&buffer, mime_type.preferredSuffix().toLatin1());
+        image_writer.write(image);
+    }
+    image_data = image_data.toBase64();
+
+    QString prefix = QString("data:%1;base64,").arg(mime_type.name());
+    QString uri;
+    uri.reserve(prefix.size() + image_data.size());
+    uri += prefix;
+    uri += QLatin1String(image_data.constData(), image_data.size());
+    return uri;
+}
+
 /**
  * \brief Class that traverses a document to output a SVG file
+ *
+ * Images are encoded on the global thread pool a few steps ahead of the
+ * one being written, so only a bounded number of them is held in memory.
  */
 class InkscapeSvgVisitor : public document::Visitor
 {
@@ -51,6 +101,15 @@ public:
 
     bool enter(document::Document& document) override
     {
+        document::visitor::LoadImages loader;
+        document.apply(loader);
+        document::visitor::CollectImages collector;
+        document.apply(collector);
+        for ( auto image : collector.images )
+            if ( image->frame() == frame )
+                pending.push_back(image->image());
+        encodeAhead();
+
         writer.writeStartElement("svg");
         writer.writeNamespace("http://www.w3.org/2000/svg");
         writer.writeNamespace("http://www.w3.org/1999/xlink", "xlink");
@@ -63,22 +122,23 @@ public:
     }
     void leave(document::Document& document) override
     {
-        /**
-         * \todo defs
-         */
-        /*
-        <defs>
-            <filter
-            inkscape:collect="always"
-            style="color-interpolation-filters:sRGB"
-            id="filter4141">
-            <feBlend
-                inkscape:collect="always"
-                mode="multiply"
-                in2="BackgroundImage" />
-            </filter>
-        </defs>
-        */
+        if ( !blend_modes.isEmpty() )
+        {
+            writer.writeStartElement("defs");
+            for ( const auto& mode : blend_modes )
+            {
+                writer.writeStartElement("filter");
+                writer.writeAttribute("inkscape:collect", "always");
+                writer.writeAttribute("style", "color-interpolation-filters:sRGB");
+                writer.writeAttribute("id", filterId(mode));
+                writer.writeEmptyElement("feBlend");
+                writer.writeAttribute("inkscape:collect", "always");
+                writer.writeAttribute("mode", mode);
+                writer.writeAttribute("in2", "BackgroundImage");
+                writer.writeEndElement();
+            }
+            writer.writeEndElement();
+        }
         writer.writeEndElement();
     }
     bool enter(document::Layer& layer) override
@@ -90,8 +150,14 @@ public:
         QString css = QString("display:%1;opacity:%2;")
             .arg(layer.visible() ? "inline" : "none")
             .arg(layer.opacity());
-         /// \todo filter:url(#filter4141)
-        writer.writeAttribute("style", "css");
+        QString mode = blendModeName(layer.blendMode());
+        if ( !mode.isEmpty() )
+        {
+            css += QString("filter:url(#%1);").arg(filterId(mode));
+            if ( !blend_modes.contains(mode) )
+                blend_modes.push_back(mode);
+        }
+        writer.writeAttribute("style", css);
         return true;
     }
     void leave(document::Layer& layer) override
@@ -106,14 +172,10 @@ public:
         writeId(image);
         writer.writeAttribute("style", "image-rendering:optimizeSpeed");
 
-        QByteArray image_data;
-        QBuffer buffer(&image_data);
-        QImageWriter image_writer(&buffer, mime_type.preferredSuffix().toLatin1());
-        image_writer.write(image.image());
-        QString image_data_string = QString("data:%1;base64,%2")
-            .arg(mime_type.name())
-            .arg(QString::fromLatin1(image_data.toBase64()));
-        writer.writeAttribute("xlink:href", image_data_string);
+        // Images are visited in the same order they have been collected
+        QFuture<QString> uri = encoding.takeFirst();
+        encodeAhead();
+        writer.writeAttribute("xlink:href", uri.result());
     }
 
 private:
@@ -123,8 +185,29 @@ private:
             writer.writeAttribute(attr, element.objectName());
     }
 
+    static QString filterId(const QString& mode)
+    {
+        return "blend-" + mode;
+    }
+
+    /**
+     * \brief Starts encoding pending images until enough are in progress
+     */
+    void encodeAhead()
+    {
+        int ahead = qMax(2, QThread::idealThreadCount() * 2);
+        while ( !pending.isEmpty() && encoding.size() < ahead )
+        {
+            QImage image = pending.takeFirst();
+            encoding.push_back(QtConcurrent::run([image]{ return dataUri(image); }));
+        }
+    }
+
     QXmlStreamWriter writer;
     document::Frame* frame;
+    QList<QImage> pending;              ///< Images not yet being encoded
+    QList<QFuture<QString>> encoding;   ///< Data URIs being encoded, in order
+    QStringList blend_modes;            ///< feBlend modes used by the layers
 };
 
 /**
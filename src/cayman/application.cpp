@@ -26,7 +26,11 @@
 #include <QTranslator>
 
 #include "data.hpp"
+#include "io/apng.hpp"
+#include "io/binary.hpp"
 #include "io/bitmap.hpp"
+#include "io/gif.hpp"
+#include "io/sprite_sheet.hpp"
 #include "io/xml.hpp"
 #include "message.hpp"
 #include "plugin/library_plugin.hpp"
@@ -41,11 +45,13 @@ namespace cayman {
 Application::Application(int& argc, char** argv)
     : QApplication(argc, argv)
 {
+    startup_timer.start();
     initInfo();
     settings_ = new settings::Settings;
     QString stylesheet = settings_->get("ui/stylesheet", QString());
     if ( !stylesheet.isEmpty() )
         setStyleSheetFile(stylesheet);
+    startupPhase("application");
 }
 
 Application::~Application()
@@ -87,14 +93,39 @@ void Application::initSubsystems()
 
     initFormats();
     initTools();
+    startupPhase("formats and tools");
     initPlugins();
+    startupPhase("plugins");
     initLanguages();
+    startupPhase("languages");
+}
+
+void Application::startupPhase(const QString& name)
+{
+    qint64 elapsed = startup_timer.elapsed();
+    startup_phases.push_back({name, elapsed - startup_last_phase});
+    startup_last_phase = elapsed;
+}
+
+void Application::reportStartup()
+{
+    if ( !settings_->get("debug/startup_report", false) )
+        return;
+
+    Message report(Msg::Stream);
+    report << tr("Startup time: %1 ms").arg(startup_last_phase);
+    for ( const auto& phase : startup_phases )
+        report << "\n    " << tr("%1: %2 ms").arg(phase.first).arg(phase.second);
 }
 
 void Application::initFormats()
 {
     io::formats().addFormat<io::FormatXmlMela>();
+    io::formats().addFormat<io::FormatBinaryMela>();
     io::formats().addFormat<io::FormatBitmap>();
+    io::formats().addFormat<io::FormatSpriteSheet>();
+    io::formats().addFormat<io::FormatGif>();
+    io::formats().addFormat<io::FormatApng>();
 }
 
 void Application::initTools()
@@ -22,6 +22,7 @@
 #define PIXEL_CAYMAN_APPLICATION_HPP
 
 #include <QApplication>
+#include <QElapsedTimer>
 #include "settings.hpp"
 
 namespace cayman {
@@ -35,6 +36,18 @@ public:
 
     void initSubsystems();
 
+    /**
+     * \brief Records the time spent since the previous startup phase
+     */
+    void startupPhase(const QString& name);
+
+    /**
+     * \brief Shows the time spent in each startup phase
+     *
+     * Only if the \c debug/startup_report setting is enabled
+     */
+    void reportStartup();
+
     void setStyleSheetFile(const QString& filename);
 
     /**
@@ -80,6 +93,10 @@ private:
     QMap<QString, QTranslator*> translators; ///< Maps language code -> translator
     QString current_language;
     QString default_language = "en_US";
+
+    QElapsedTimer startup_timer;
+    qint64 startup_last_phase = 0;
+    QList<QPair<QString, qint64>> startup_phases; ///< Phase name -> milliseconds
 };
 
 
@@ -0,0 +1,240 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "batch.hpp"
+
+#include <memory>
+
+#include <QDir>
+#include <QDirIterator>
+#include <QHash>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include "io/formats.hpp"
+#include "message.hpp"
+
+namespace cayman {
+
+Batch::Batch(int argc, char** argv)
+    : option_batch({"b", "batch"},
+        tr("Convert the input files without showing the user interface")),
+      option_export({"e", "export"},
+        tr("Format id or file extension to convert the files to (implies --batch)"),
+        tr("format")),
+      option_output({"o", "output"},
+        tr("Directory where the converted files are written, "
+           "by default they are placed next to the input files"),
+        tr("directory")),
+      option_jobs({"j", "jobs"},
+        tr("Number of files to convert at the same time"),
+        tr("count"),
+        QString::number(QThread::idealThreadCount()))
+{
+    parser.addHelpOption();
+    parser.addOption(option_batch);
+    parser.addOption(option_export);
+    parser.addOption(option_output);
+    parser.addOption(option_jobs);
+    parser.addPositionalArgument("files",
+        tr("Files or directories to convert"), tr("[files...]"));
+
+    for ( int i = 0; i < argc; i++ )
+        arguments << QString::fromLocal8Bit(argv[i]);
+
+    parsed = parser.parse(arguments);
+    enabled_ = parser.isSet(option_batch) || parser.isSet(option_export);
+
+    // There are no windows to show, but the platform is still needed
+    // for fonts, images and plugins
+    if ( enabled_ && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") )
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+}
+
+int Batch::run()
+{
+    if ( !parsed )
+    {
+        Message(Msg::Stream|Msg::Error) << parser.errorText();
+        return 1;
+    }
+
+    if ( parser.isSet("help") )
+        parser.showHelp(0);
+
+    QString format_name = parser.value(option_export);
+    if ( format_name.isEmpty() )
+    {
+        Message(Msg::Stream|Msg::Error) << tr("No output format, use --export");
+        return 1;
+    }
+
+    io::AbstractFormat* format = io::formats().format(format_name);
+    if ( !format )
+        format = io::formats().formatFromFileName("."+format_name, io::Formats::Action::Save);
+    if ( !format || !format->canSave() )
+    {
+        Message(Msg::Stream|Msg::Error) << tr("Unknown output format %1").arg(format_name);
+        return 1;
+    }
+
+    bool jobs_ok = false;
+    int thread_count = parser.value(option_jobs).toInt(&jobs_ok);
+    if ( !jobs_ok || thread_count < 1 )
+    {
+        Message(Msg::Stream|Msg::Error) << tr("Invalid number of jobs: %1")
+            .arg(parser.value(option_jobs));
+        return 1;
+    }
+
+    int skipped = 0;
+    QList<Job> jobs = this->jobs(format, skipped);
+    if ( jobs.isEmpty() && !skipped )
+    {
+        Message(Msg::Stream|Msg::Error) << tr("No input files");
+        return 1;
+    }
+
+    // Inputs with the same base name would overwrite each other's output
+    QHash<QString, QString> outputs;
+    for ( const Job& job : jobs )
+    {
+        QString output = QFileInfo(job.output).absoluteFilePath();
+        auto iter = outputs.find(output);
+        if ( iter != outputs.end() )
+        {
+            Message(Msg::Stream|Msg::Error) << tr("%1 and %2 would both be converted to %3")
+                .arg(*iter).arg(job.input).arg(job.output);
+            return 1;
+        }
+        outputs.insert(output, job.input);
+    }
+
+    // The global pool is left free for the work done by the formats
+    QThreadPool pool;
+    pool.setMaxThreadCount(thread_count);
+    QList<QFuture<QString>> results;
+    for ( const Job& job : jobs )
+        results.push_back(QtConcurrent::run(&pool, &Batch::convert, job, format));
+
+    // Skipped inputs have already been reported
+    int failed = skipped;
+    for ( int i = 0; i < jobs.size(); i++ )
+    {
+        QString error = results[i].result();
+        if ( error.isEmpty() )
+        {
+            Message(Msg::Stream) << QString("%1 -> %2").arg(jobs[i].input).arg(jobs[i].output);
+        }
+        else
+        {
+            Message(Msg::Stream|Msg::Error) << QString("%1: %2").arg(jobs[i].input).arg(error);
+            failed++;
+        }
+    }
+
+    if ( failed )
+    {
+        Message(Msg::Stream|Msg::Error) << tr("%1 of %2 files could not be converted")
+            .arg(failed).arg(jobs.size() + skipped);
+        return 1;
+    }
+
+    return 0;
+}
+
+QList<Batch::Job> Batch::jobs(const io::AbstractFormat* format, int& skipped) const
+{
+    QString output_dir = parser.value(option_output);
+    QString extension = format->extensions(io::Formats::Action::Save).value(0, format->id());
+
+    QStringList name_filters;
+    for ( auto input_format : io::formats().formats() )
+        if ( input_format->canOpen() )
+            for ( const auto& ext : input_format->extensions(io::Formats::Action::Open) )
+                name_filters << "*."+ext;
+
+    QList<Job> jobs;
+    skipped = 0;
+    auto add_job = [&jobs, &skipped, &output_dir, &extension](const QFileInfo& input, const QString& relative)
+    {
+        QFileInfo relative_info(relative);
+        QString output = relative_info.path() + '/' + relative_info.completeBaseName() + '.' + extension;
+        if ( output_dir.isEmpty() )
+            output = input.dir().filePath(QFileInfo(output).fileName());
+        else
+            output = QDir(output_dir).filePath(output);
+        output = QDir::cleanPath(output);
+
+        // Converting to the same format next to the input
+        if ( QFileInfo(output) == input )
+        {
+            Message(Msg::Stream|Msg::Error) << tr("%1: skipped, the output would overwrite it")
+                .arg(input.filePath());
+            skipped++;
+            return;
+        }
+
+        jobs.push_back({input.filePath(), output});
+    };
+
+    for ( const QString& path : parser.positionalArguments() )
+    {
+        QFileInfo info(path);
+        if ( info.isDir() )
+        {
+            // Keep the directory structure in the output directory
+            QDir root(path);
+            QDirIterator iter(path, name_filters, QDir::Files, QDirIterator::Subdirectories);
+            while ( iter.hasNext() )
+            {
+                iter.next();
+                add_job(iter.fileInfo(), root.relativeFilePath(iter.filePath()));
+            }
+        }
+        else
+        {
+            add_job(info, info.fileName());
+        }
+    }
+
+    return jobs;
+}
+
+QString Batch::convert(const Job& job, io::AbstractFormat* format)
+{
+    auto input_format = io::formats().formatFromFileName(job.input, io::Formats::Action::Open);
+    if ( !input_format )
+        return tr("Unsupported file format");
+
+    std::unique_ptr<document::Document> document(input_format->open(job.input));
+    if ( !document )
+        return input_format->hasError() ? input_format->errorString() : tr("Could not open the file");
+
+    QDir().mkpath(QFileInfo(job.output).absolutePath());
+    if ( !format->save(document.get(), job.output) )
+        return format->hasError() ? format->errorString() : tr("Could not save the file");
+
+    return QString();
+}
+
+} // namespace cayman
@@ -0,0 +1,99 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_BATCH_HPP
+#define PIXEL_CAYMAN_BATCH_HPP
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+namespace io { class AbstractFormat; }
+
+namespace cayman {
+
+/**
+ * \brief Headless conversion of files from the command line
+ *
+ * Enabled by \c --batch or \c --export, converts all the files (or the
+ * supported files found in the directories) passed as positional arguments
+ * to the format selected with \c --export, in parallel.
+ */
+class Batch
+{
+    Q_DECLARE_TR_FUNCTIONS(Batch)
+
+public:
+    /**
+     * \brief Checks whether batch mode has been requested
+     *
+     * Must be constructed before the application object since it selects
+     * the offscreen platform when running in batch mode.
+     */
+    Batch(int argc, char** argv);
+
+    /**
+     * \brief Whether the command line requested batch mode
+     */
+    bool enabled() const
+    {
+        return enabled_;
+    }
+
+    /**
+     * \brief Converts all the input files
+     * \pre The application has been created and its subsystems initialized
+     * \return The process exit code
+     */
+    int run();
+
+private:
+    /**
+     * \brief A file to convert
+     */
+    struct Job
+    {
+        QString input;
+        QString output;
+    };
+
+    /**
+     * \brief Finds the files to convert
+     * \param skipped Set to the number of inputs whose output would overwrite them
+     */
+    QList<Job> jobs(const io::AbstractFormat* format, int& skipped) const;
+
+    /**
+     * \brief Converts a single file
+     * \return An error message, empty on success
+     */
+    static QString convert(const Job& job, io::AbstractFormat* format);
+
+    QStringList arguments;
+    QCommandLineParser parser;
+    QCommandLineOption option_batch;
+    QCommandLineOption option_export;
+    QCommandLineOption option_output;
+    QCommandLineOption option_jobs;
+    bool parsed = false;
+    bool enabled_ = false;
+};
+
+} // namespace cayman
+#endif // PIXEL_CAYMAN_BATCH_HPP
@@ -22,6 +22,7 @@
 #define PIXEL_CAYMAN_SETTINGS_HPP
 
 #include <type_traits>
+#include <QMutex>
 #include <QSettings>
 
 namespace cayman {
@@ -48,6 +49,7 @@ public:
     template<class T>
         void put(const QString& name, T&& value)
         {
+            QMutexLocker lock(&mutex_);
             settings_.setValue(name,
                 QVariant::fromValue(std::forward<T>(value)));
         }
@@ -57,6 +59,7 @@ public:
         {
             using Type = typename std::remove_reference<T>::type;
 
+            QMutexLocker lock(&mutex_);
             QVariant variant = settings_.value(name);
 
             if ( variant.canConvert<Type>() )
@@ -111,6 +114,8 @@ private:
     friend class cayman::Application;
 
     QSettings settings_;
+    /// Formats read their settings from worker threads
+    QMutex mutex_{QMutex::Recursive};
 
     static Settings* singleton;
 };
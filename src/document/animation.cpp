@@ -22,6 +22,7 @@
 
 #include "animation.hpp"
 #include "visitor.hpp"
+#include "command/add_element.hpp"
 
 namespace document {
 
@@ -51,6 +52,16 @@ void Animation::setName(const QString& name)
     name_ = name;
 }
 
+Document* Animation::parentDocument() const
+{
+    return document_;
+}
+
+void Animation::parentDocumentSet(Document* document)
+{
+    document_ = document;
+}
+
 int Animation::framesPerSecond() const
 {
     return fps_;
@@ -61,4 +72,101 @@ void Animation::setFramesPerSecond(int fps)
     fps_ = fps;
 }
 
+QList<Frame*> Animation::frames() const
+{
+    return frames_;
+}
+
+int Animation::count() const
+{
+    return frames_.size();
+}
+
+Frame* Animation::frame(int i)
+{
+    if ( i < 0 || i >= frames_.size() )
+        return nullptr;
+    return frames_[i];
+}
+
+Frame* Animation::createFrame(int position, int copy)
+{
+    if ( position < 0 || position > frames_.size() )
+        position = frames_.size();
+
+    Frame* frame = new Frame(this);
+    if ( !document_ )
+    {
+        frames_.insert(position, frame);
+        emit edited();
+        return frame;
+    }
+
+    Frame* source = copy >= 0 && copy < frames_.size() ? frames_[copy] : nullptr;
+
+    document_->registerElement(frame);
+    document_->undoStack().beginMacro(tr("Add Frame"));
+
+    document_->pushCommand(command::newAddElement(
+        tr("Add Frame"), frame,
+        [this, frame, position]{
+            frames_.insert(position, frame);
+            emit edited();
+        },
+        [this, frame]{
+            frames_.removeOne(frame);
+            emit edited();
+        }
+    ));
+
+    if ( source )
+    {
+        visitor::CollectImages collect;
+        document_->apply(collect);
+        for ( Image* image : collect.images )
+            if ( image->frame() == source )
+                image->layer()->insertFrameImage(image->image(), frame);
+    }
+
+    document_->undoStack().endMacro();
+    return frame;
+}
+
+void Animation::removeFrame(int position)
+{
+    if ( position < 0 || position >= frames_.size() )
+        return;
+
+    Frame* frame = frames_[position];
+    if ( !document_ )
+    {
+        frames_.removeAt(position);
+        delete frame;
+        emit edited();
+        return;
+    }
+
+    document_->undoStack().beginMacro(tr("Remove Frame"));
+
+    visitor::CollectImages collect;
+    document_->apply(collect);
+    for ( Image* image : collect.images )
+        if ( image->frame() == frame )
+            image->layer()->removeFrameImage(image);
+
+    document_->pushCommand(command::newRemoveElement(
+        tr("Remove Frame"), frame,
+        [this, frame, position]{
+            frames_.insert(position, frame);
+            emit edited();
+        },
+        [this, frame]{
+            frames_.removeOne(frame);
+            emit edited();
+        }
+    ));
+
+    document_->undoStack().endMacro();
+}
+
 } // namespace document
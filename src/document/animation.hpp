@@ -25,6 +25,9 @@
 
 namespace document {
 
+/**
+ * \brief Sequence of frames played at a given frame rate
+ */
 class Animation : public DocumentElement
 {
     Q_OBJECT
@@ -39,16 +42,35 @@ public:
 
     QList<Frame*> frames() const;
     int count() const;
+    /**
+     * \brief Frame at position \p i, \b nullptr if out of range
+     */
     Frame* frame(int i);
+    /**
+     * \brief Creates a new frame
+     * \param position Index of the new frame, -1 to append it
+     * \param copy     Index of a frame whose images are copied into the new one,
+     *                 -1 to create an empty frame
+     *
+     * The frame and the copied images are added as a single undoable command
+     */
     Frame* createFrame(int position = -1, int copy = -1);
+    /**
+     * \brief Removes a frame and its images
+     */
     void removeFrame(int position);
 
     void apply(Visitor& visitor) override;
+    Document* parentDocument() const override;
+
+protected:
+    void parentDocumentSet(Document* document) override;
 
 private:
     QString name_;
     int fps_;
     QList<Frame*> frames_;
+    Document* document_ = nullptr;
 };
 
 } // namespace document
@@ -158,6 +158,22 @@ public:
         return image;
     }
 
+    /**
+     * \brief Creates an image with the given contents
+     * \pre Called after beginLayer()
+     * \post currentImage() != nullptr
+     *
+     * A null \p contents can be used to create a placeholder for images
+     * which will be assigned a source with Image::setSource()
+     */
+    Image* beginImage(const QImage& contents)
+    {
+        endImage();
+        image = layer->addFrameImage(contents);
+        element = image;
+        return image;
+    }
+
     /**
      * \brief Currently edited Image
      * \pre Called after beginImage()
@@ -188,43 +204,85 @@ public:
         image = nullptr;
     }
 
+    /**
+     * \brief Creates an animation
+     * \pre Called after beginDocument()
+     * \post currentAnimation() != nullptr
+     */
     Animation* beginAnimation()
     {
-        /// \todo Animations
-        return nullptr;
+        endAnimation();
+        animation = document->addAnimation(QString());
+        element = animation;
+        return animation;
     }
 
+    /**
+     * \brief Currently edited animation
+     * \pre Called after beginAnimation()
+     */
     Animation* currentAnimation()
     {
-        /// \todo Animations
-        return nullptr;
+        return animation;
     }
 
+    /**
+     * \brief Finishes the current animation
+     * \post currentAnimation() == nullptr
+     */
     void endAnimation()
     {
-        /// \todo Animations
+        endFrame();
+        if ( !animation )
+            return;
+        animation = nullptr;
+        element = document;
     }
 
+    /**
+     * \brief Appends a frame to the current animation
+     * \param id Temporary ID images refer to, see setImageFrame()
+     * \pre Called after beginAnimation()
+     * \post currentFrame() != nullptr
+     */
     Frame* beginFrame(const QString& id = QString())
     {
-        /// \todo Animations (insert in frames)
-        return nullptr;
+        endFrame();
+        frame = animation->createFrame();
+        element = frame;
+        setFrameId(id);
+        return frame;
     }
 
+    /**
+     * \brief Sets the temporary ID of the current frame
+     * \pre Called after beginFrame()
+     */
     void setFrameId(const QString& id)
     {
-        /// \todo insert in frames
+        if ( !id.isEmpty() )
+            frames[id].frame = frame;
     }
 
+    /**
+     * \brief Currently edited frame
+     * \pre Called after beginFrame()
+     */
     Frame* currentFrame()
     {
-        /// \todo Animations
-        return nullptr;
+        return frame;
     }
 
+    /**
+     * \brief Finishes the current frame
+     * \post currentFrame() == nullptr
+     */
     void endFrame()
     {
-        /// \todo Animations
+        if ( !frame )
+            return;
+        frame = nullptr;
+        element = animation;
     }
 
 private:
@@ -251,6 +309,8 @@ private:
     DocumentElement* element = nullptr;
     Layer* layer = nullptr;
     Image* image = nullptr;
+    Animation* animation = nullptr;
+    Frame* frame = nullptr;
     QHash<QString, FrameReference>  frames;
 };
 
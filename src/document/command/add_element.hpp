@@ -0,0 +1,111 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_DOCUMENT_COMMAND_ADD_ELEMENT_HPP
+#define PIXEL_CAYMAN_DOCUMENT_COMMAND_ADD_ELEMENT_HPP
+
+#include <QUndoCommand>
+
+namespace document {
+namespace command {
+
+/**
+ * \brief Command to add or remove an element
+ *
+ * While the element isn't part of the document the command owns it,
+ * so it's deleted along with the command.
+ */
+template<class Element, class Insert, class Remove>
+    class AddElement : public QUndoCommand
+{
+public:
+    AddElement(const QString& name,
+               Element* element,
+               const Insert& insert,
+               const Remove& remove,
+               bool add = true,
+               QUndoCommand* parent = nullptr)
+        : QUndoCommand(name, parent),
+          element(element),
+          insert(insert),
+          remove(remove),
+          add(add),
+          in_document(!add)
+    {}
+
+    ~AddElement()
+    {
+        if ( !in_document )
+            delete element;
+    }
+
+    void undo() override
+    {
+        if ( add )
+            remove();
+        else
+            insert();
+        in_document = !add;
+    }
+
+    void redo() override
+    {
+        if ( add )
+            insert();
+        else
+            remove();
+        in_document = add;
+    }
+
+private:
+    Element* element;
+    Insert insert;
+    Remove remove;
+    bool add;
+    bool in_document;
+};
+
+template<class Element, class Insert, class Remove>
+    AddElement<Element, Insert, Remove>* newAddElement(
+        const QString& name,
+        Element* element,
+        const Insert& insert,
+        const Remove& remove,
+        QUndoCommand* parent = nullptr)
+    {
+        return new AddElement<Element, Insert, Remove>(
+            name, element, insert, remove, true, parent);
+    }
+
+template<class Element, class Insert, class Remove>
+    AddElement<Element, Insert, Remove>* newRemoveElement(
+        const QString& name,
+        Element* element,
+        const Insert& insert,
+        const Remove& remove,
+        QUndoCommand* parent = nullptr)
+    {
+        return new AddElement<Element, Insert, Remove>(
+            name, element, insert, remove, false, parent);
+    }
+
+} // namespace command
+} // namespace document
+#endif // PIXEL_CAYMAN_DOCUMENT_COMMAND_ADD_ELEMENT_HPP
@@ -30,13 +30,20 @@ namespace command {
 void ChangeImage::undo()
 {
     image->image() = before;
-    emit image->edited();
+    notify();
 }
 
 void ChangeImage::redo()
 {
     image->image() = after;
-    emit image->edited();
+    notify();
+}
+
+void ChangeImage::notify()
+{
+    // edited() would make views re-composite the whole document,
+    // markDirty() updates the revision and only the affected area
+    image->markDirty(dirty.isValid() ? dirty : image->image().rect());
 }
 
 } // namespace command
@@ -49,14 +49,27 @@ public:
         after = image;
     }
 
+    /**
+     * \brief Extends the area known to differ between the two images
+     *
+     * If no area is set, the whole image is considered changed
+     */
+    void addDirtyRect(const QRect& rect)
+    {
+        dirty |= rect;
+    }
+
     void undo() override;
 
     void redo() override;
 
 private:
+    void notify();
+
     Image* image;
     QImage before;
     QImage after;
+    QRect dirty;
 };
 
 } // namespace command
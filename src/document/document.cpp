@@ -22,7 +22,10 @@
 
 #include "document.hpp"
 #include "visitor.hpp"
+#include <numeric>
 #include <QFileInfo>
+#include <QtConcurrent>
+#include "command/add_element.hpp"
 #include "command/set_property.hpp"
 
 namespace document {
@@ -31,13 +34,31 @@ namespace document {
 Document::Document(const Metadata& metadata)
     : LayerContainer(metadata)
 {
-    auto lambda = [this]
-    {
-        color_table = palette_.colorTable();
-        emit paletteChanged(palette_);
-    };
-    connect(&palette_, &color_widgets::ColorPalette::colorsChanged, this, lambda);
-    connect(&palette_, &color_widgets::ColorPalette::colorsUpdated, this, lambda);
+    // Single entry edits are tracked so images can be remapped
+    // instead of being converted again
+    connect(&palette_, &color_widgets::ColorPalette::colorChanged, this, [this](int) {
+        initPaletteRemap();
+    });
+    connect(&palette_, &color_widgets::ColorPalette::colorAdded, this, [this](int index) {
+        initPaletteRemap();
+        for ( int& entry : palette_remap )
+            if ( entry >= index )
+                entry++;
+    });
+    connect(&palette_, &color_widgets::ColorPalette::colorRemoved, this, [this](int index) {
+        initPaletteRemap();
+        for ( int& entry : palette_remap )
+            if ( entry == index )
+                entry = -1;
+            else if ( entry > index )
+                entry--;
+    });
+    connect(&palette_, &color_widgets::ColorPalette::colorsChanged, this, [this]{
+        palette_remap.clear();
+        paletteEdited();
+    });
+    connect(&palette_, &color_widgets::ColorPalette::colorsUpdated,
+            this, &Document::paletteEdited);
 }
 
 Document::Document(const QSize& size,
@@ -83,6 +104,20 @@ void Document::setFileName(const QString& file_name)
         emit fileNameChanged( this->file_name = file_name );
 }
 
+QString Document::damagedFile() const
+{
+    return damaged_file;
+}
+
+void Document::reportLoadFailure()
+{
+    if ( damaged_file.isEmpty() )
+    {
+        damaged_file = file_name;
+        emit loadFailed(file_name);
+    }
+}
+
 QSize Document::imageSize() const
 {
     return image_size;
@@ -101,6 +136,79 @@ void Document::apply(Visitor& visitor)
     }
 }
 
+QList<const Animation*> Document::animations() const
+{
+    QList<const Animation*> list;
+    for ( auto anim : animations_ )
+        list.push_back(anim);
+    return list;
+}
+
+QList<Animation*> Document::animations()
+{
+    return animations_;
+}
+
+const Animation* Document::animation(const QString& name) const
+{
+    for ( auto anim : animations_ )
+        if ( anim->name() == name )
+            return anim;
+    return nullptr;
+}
+
+Animation* Document::animation(const QString& name)
+{
+    for ( auto anim : animations_ )
+        if ( anim->name() == name )
+            return anim;
+    return nullptr;
+}
+
+Animation* Document::addAnimation(const QString& name)
+{
+    Animation* anim = new Animation(name);
+    registerElement(anim);
+    pushCommand(command::newAddElement(
+        tr("Add Animation"), anim,
+        [this, anim]{
+            animations_.push_back(anim);
+            emit edited();
+        },
+        [this, anim]{
+            animations_.removeOne(anim);
+            emit edited();
+        }
+    ));
+    return anim;
+}
+
+void Document::removeAnimation(Animation* animation)
+{
+    int index = animations_.indexOf(animation);
+    if ( index == -1 )
+        return;
+
+    undo_stack.beginMacro(tr("Remove Animation"));
+
+    while ( animation->count() )
+        animation->removeFrame(animation->count() - 1);
+
+    pushCommand(command::newRemoveElement(
+        tr("Remove Animation"), animation,
+        [this, animation, index]{
+            animations_.insert(index, animation);
+            emit edited();
+        },
+        [this, animation]{
+            animations_.removeOne(animation);
+            emit edited();
+        }
+    ));
+
+    undo_stack.endMacro();
+}
+
 Document* Document::parentDocument() const
 {
     return const_cast<Document*>(this);
@@ -204,13 +312,218 @@ void Document::setIndexedColors(bool uses_palette)
 {
     if ( uses_palette != indexed_colors_ )
     {
+        // The conversion is pushed after the toggle rather than from the
+        // setter, undo and redo must not push further commands
+        undo_stack.beginMacro(tr("Toggle indexed colors"));
         pushCommand(command::newSetProperty(
             tr("Toggle indexed colors"), indexed_colors_, uses_palette,
             [this](bool uses_palette) {
                 emit indexedColorsChanged( indexed_colors_ = uses_palette );
                 emit paletteChanged(palette_);
         }));
+        updateColors();
+        undo_stack.endMacro();
+    }
+}
+
+bool Document::paletteLocked() const
+{
+    return palette_locked_;
+}
+
+void Document::setPaletteLocked(bool locked)
+{
+    if ( locked != palette_locked_ )
+        emit paletteLockedChanged(palette_locked_ = locked);
+}
+
+const misc::Quantizer& Document::quantizer() const
+{
+    if ( quantizer_.colorTable() != color_table )
+        quantizer_ = misc::Quantizer(color_table);
+    return quantizer_;
+}
+
+void Document::initPaletteRemap()
+{
+    if ( palette_remap.isEmpty() )
+    {
+        palette_remap.resize(color_table.size());
+        std::iota(palette_remap.begin(), palette_remap.end(), 0);
+    }
+}
+
+void Document::paletteEdited()
+{
+    QVector<int> remap;
+    remap.swap(palette_remap);
+
+    QVector<QRgb> old_table = palette_.colorTable();
+    old_table.swap(color_table);
+    emit paletteChanged(palette_);
+
+    if ( !indexed_colors_ )
+    {
+        if ( palette_locked_ && !remap.isEmpty() )
+            replaceColors(old_table, remap);
+        return;
+    }
+
+    if ( remap.isEmpty() )
+        updateColors();
+    else
+        remapColors(remap);
+}
+
+void Document::remapColors(const QVector<int>& remap)
+{
+    quantizer();
+
+    visitor::CollectImages collector;
+    apply(collector);
+
+    bool moved = false;
+    for ( int i = 0; i < remap.size() && !moved; i++ )
+        moved = remap[i] != i;
+
+    // Only the colors have changed, the pixels stay the same
+    if ( !moved )
+    {
+        bool changed = false;
+        for ( auto image : collector.images )
+        {
+            // Lazy images pick up the color table when they load
+            if ( !image->isLoaded() )
+                continue;
+            const QImage& pixels = image->image();
+            if ( pixels.format() != QImage::Format_Indexed8 || pixels.colorTable() == color_table )
+                continue;
+            if ( !changed )
+            {
+                undo_stack.beginMacro(tr("Change Colors"));
+                changed = true;
+            }
+            image->setColorTable(color_table);
+        }
+        if ( changed )
+            undo_stack.endMacro();
+        return;
+    }
+
+    struct Conversion
+    {
+        Image* image;
+        QImage result;
+    };
+    QVector<Conversion> conversions;
+    for ( auto image : collector.images )
+        conversions.push_back({image, QImage()});
+
+    QtConcurrent::blockingMap(conversions, [&remap](Conversion& conversion) {
+        conversion.result = conversion.image->remapColors(remap);
+    });
+
+    bool changed = false;
+    for ( const auto& conversion : conversions )
+    {
+        if ( conversion.result.isNull() )
+            continue;
+        if ( !changed )
+        {
+            undo_stack.beginMacro(tr("Convert Colors"));
+            changed = true;
+        }
+        conversion.image->applyColors(conversion.result);
+    }
+    if ( changed )
+        undo_stack.endMacro();
+}
+
+void Document::replaceColors(const QVector<QRgb>& old_table, const QVector<int>& remap)
+{
+    QHash<QRgb, QRgb> colors;
+    for ( int i = 0; i < remap.size() && i < old_table.size(); i++ )
+    {
+        int index = remap[i];
+        // Pixels of removed entries are left alone
+        if ( index >= 0 && index < color_table.size() && old_table[i] != color_table[index] )
+            colors.insert(old_table[i], color_table[index]);
+    }
+
+    if ( colors.isEmpty() )
+        return;
+
+    visitor::CollectImages collector;
+    apply(collector);
+
+    struct Conversion
+    {
+        Image* image;
+        QImage result;
+    };
+    QVector<Conversion> conversions;
+    for ( auto image : collector.images )
+        conversions.push_back({image, QImage()});
+
+    QtConcurrent::blockingMap(conversions, [&colors](Conversion& conversion) {
+        conversion.result = conversion.image->replaceColors(colors);
+    });
+
+    bool changed = false;
+    for ( const auto& conversion : conversions )
+    {
+        if ( conversion.result.isNull() )
+            continue;
+        if ( !changed )
+        {
+            undo_stack.beginMacro(tr("Change Colors"));
+            changed = true;
+        }
+        conversion.image->applyColors(conversion.result);
+    }
+    if ( changed )
+        undo_stack.endMacro();
+}
+
+void Document::updateColors()
+{
+    // Build the lookup table before the images access it from other threads
+    quantizer();
+
+    visitor::CollectImages collector;
+    apply(collector);
+
+    struct Conversion
+    {
+        Image* image;
+        QImage result;
+    };
+    QVector<Conversion> conversions;
+    for ( auto image : collector.images )
+    {
+        // Unloaded images can only be indexed if the document is
+        if ( indexed_colors_ || image->isLoaded() )
+            conversions.push_back({image, QImage()});
+    }
+
+    QtConcurrent::blockingMap(conversions, [](Conversion& conversion) {
+        conversion.result = conversion.image->convertColors();
+    });
+
+    bool changed = false;
+    for ( const auto& conversion : conversions )
+    {
+        if ( conversion.result.isNull() )
+            continue;
+        if ( !changed )
+        {
+            undo_stack.beginMacro(tr("Convert Colors"));
+            changed = true;
+        }
+        conversion.image->applyColors(conversion.result);
     }
+    if ( changed )
+        undo_stack.endMacro();
 }
 
 } // namespace document
@@ -26,6 +26,7 @@
 #include "layer.hpp"
 #include "format_settings.hpp"
 #include "color_palette.hpp"
+#include "misc/quantizer.hpp"
 
 namespace document {
 
@@ -84,6 +85,15 @@ public:
     QString fileName() const;
     void setFileName(const QString& file_name);
 
+    /**
+     * \brief File some images couldn't be decoded from,
+     *        empty if all of them have been loaded
+     *
+     * Those images are left transparent, saving over this file would lose
+     * their original pixels.
+     */
+    QString damagedFile() const;
+
     /**
      * \brief Image size, must be consistent with the size of the layer images
      */
@@ -182,27 +192,114 @@ public:
     bool indexedColors() const;
     void setIndexedColors(bool uses_palette);
 
+    /**
+     * \brief Whether editing a palette entry recolors the pixels of
+     *        full color images which used its old color
+     *
+     * Indexed images always follow the palette.
+     */
+    bool paletteLocked() const;
+    void setPaletteLocked(bool locked);
+
+    /**
+     * \brief Maps colors to the entries of colorTable()
+     */
+    const misc::Quantizer& quantizer() const;
+
+    /**
+     * \brief Dithering used when images are converted to indexed colors
+     */
+    misc::Quantizer::Dither dither() const
+    {
+        return dither_;
+    }
+
+    void setDither(misc::Quantizer::Dither dither)
+    {
+        dither_ = dither;
+    }
+
 signals:
     void fileNameChanged(const QString& fileName);
+    /**
+     * \brief Emitted the first time an image from \p fileName
+     *        can't be decoded
+     */
+    void loadFailed(const QString& fileName);
     void indexedColorsChanged(bool indexedColors);
+    void paletteLockedChanged(bool paletteLocked);
     void paletteChanged(const color_widgets::ColorPalette& palette);
     void imageSizeChanged(const QSize& imageSize);
 
+    /**
+     * \brief Emitted when the pixels of \p image have changed within \p rect
+     *
+     * Unlike edited(), it allows views to only redraw the affected area
+     */
+    void imageEdited(Image* image, const QRect& rect);
+
 protected:
     void onInsertLayer(Layer* layer) override;
     void onRemoveLayer(Layer* layer) override;
 
 private:
+    /**
+     * \brief Converts all the images to the current color mode
+     *
+     * The images are converted in parallel, then the changes are pushed
+     * to the undo stack as a single command.
+     */
+    void updateColors();
+
+    /**
+     * \brief Updates indexed images after some palette entries have been
+     *        edited, added or removed
+     * \param remap Maps the old palette indices to the new ones,
+     *              -1 for removed entries
+     */
+    void remapColors(const QVector<int>& remap);
+
+    /**
+     * \brief Recolors full color images after some palette entries have
+     *        been edited
+     * \param old_table Color table before the edit
+     * \param remap     Maps the old palette indices to the new ones
+     */
+    void replaceColors(const QVector<QRgb>& old_table, const QVector<int>& remap);
+
+    /**
+     * \brief Starts tracking index changes from the current color table
+     */
+    void initPaletteRemap();
+
+    /**
+     * \brief Called when the palette colors have changed
+     */
+    void paletteEdited();
+
     void registerElement(DocumentElement* element, const QMetaObject& meta);
 
+    /**
+     * \brief Called when an image can't be decoded
+     *
+     * Images invoke it through the meta-object as they can be decoded
+     * in other threads.
+     */
+    Q_INVOKABLE void reportLoadFailure();
+
     QList<Animation*>   animations_;
     QSize               image_size;
     QString             file_name;
+    QString             damaged_file;
     QUndoStack          undo_stack;
     FormatSettings      format_settings;
     color_widgets::ColorPalette palette_;
     bool                indexed_colors_ = false;
+    bool                palette_locked_ = false;
     QVector<QRgb>       color_table;
+    QVector<int>        palette_remap; ///< See remapColors(), empty when not tracking
+    mutable misc::Quantizer quantizer_;
+    misc::Quantizer::Dither dither_ = misc::Quantizer::Dither::FloydSteinberg;
 };
 
 } // namespace document
@@ -0,0 +1,59 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "frame.hpp"
+#include "animation.hpp"
+#include "visitor.hpp"
+
+namespace document {
+
+Frame::Frame(Animation* animation)
+    : animation_(animation)
+{
+}
+
+Animation* Frame::animation()
+{
+    return animation_;
+}
+
+const Animation* Frame::animation() const
+{
+    return animation_;
+}
+
+int Frame::frameNumber() const
+{
+    return animation_->frames().indexOf(const_cast<Frame*>(this));
+}
+
+void Frame::apply(Visitor& visitor)
+{
+    visitor.visit(*this);
+}
+
+Document* Frame::parentDocument() const
+{
+    return animation_->parentDocument();
+}
+
+} // namespace document
@@ -27,17 +27,30 @@ namespace document {
 
 class Animation;
 
+/**
+ * \brief A frame of an animation
+ *
+ * Images are associated with a frame through Image::frame()
+ */
 class Frame : public DocumentElement
 {
     Q_OBJECT
 public:
+    explicit Frame(Animation* animation);
 
     Animation* animation();
     const Animation* animation() const;
 
+    /**
+     * \brief Position of the frame within its animation
+     */
     int frameNumber() const;
 
-    //void apply(Visitor& visitor) override;
+    void apply(Visitor& visitor) override;
+    Document* parentDocument() const override;
+
+private:
+    Animation* animation_;
 };
 
 } // namespace document
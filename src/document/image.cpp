@@ -22,28 +22,37 @@
 
 #include "image.hpp"
 #include "visitor.hpp"
+#include "command/set_property.hpp"
+#include <atomic>
 #include <QPainter>
+#include <QtConcurrent/QtConcurrentRun>
 
 namespace document {
 
+static std::atomic<quint64> next_revision(1);
+
 Image::Image(Layer* layer, const QImage& image,  Frame* frame)
-    : image_(image), frame_(frame), layer_(layer)
+    : image_(image), frame_(frame), layer_(layer), revision_(next_revision++)
 {
+    connect(this, &DocumentElement::edited, [this]{ revision_ = next_revision++; });
     layer->parentDocument()->registerElement(this);
-    setColors();
+    initColors();
 }
 
 Image::Image(Layer* layer, const QSize& size, const QColor& color,  Frame* frame)
-    : image_(size, QImage::Format_ARGB32), frame_(frame), layer_(layer)
+    : image_(size, QImage::Format_ARGB32), frame_(frame), layer_(layer),
+      revision_(next_revision++)
 {
+    connect(this, &DocumentElement::edited, [this]{ revision_ = next_revision++; });
     image_.fill(color);
     layer->parentDocument()->registerElement(this);
-    setColors();
+    initColors();
 }
 
 Image::~Image()
 {
     endPainting();
+    delete pending_;
 }
 
 void Image::apply(Visitor& visitor)
@@ -53,19 +62,80 @@ void Image::apply(Visitor& visitor)
 
 QImage& Image::image()
 {
+    ensureLoaded();
     return image_;
 }
 
 const QImage& Image::image() const
 {
+    ensureLoaded();
     return image_;
 }
 
 void Image::paint(QPainter& painter) const
 {
+    ensureLoaded();
     painter.drawImage(0, 0, image_);
 }
 
+void Image::setSource(const QSharedPointer<ImageSource>& source)
+{
+    delete pending_;
+    pending_ = new PendingLoad;
+    pending_->source = source;
+    image_ = QImage();
+}
+
+bool Image::isLoaded() const
+{
+    return !pending_;
+}
+
+QSharedPointer<ImageSource> Image::source() const
+{
+    return pending_ ? pending_->source : QSharedPointer<ImageSource>();
+}
+
+void Image::prefetch()
+{
+    if ( !pending_ || pending_->prefetching )
+        return;
+
+    auto source = pending_->source;
+    pending_->future = QtConcurrent::run([source]{ return source->load(); });
+    pending_->prefetching = true;
+}
+
+quint64 Image::revision() const
+{
+    return revision_;
+}
+
+void Image::ensureLoaded() const
+{
+    if ( !pending_ )
+        return;
+
+    QImage loaded = pending_->prefetching ?
+        pending_->future.result() : pending_->source->load();
+    delete pending_;
+    pending_ = nullptr;
+
+    if ( loaded.isNull() )
+    {
+        // Queued when decoding in a worker thread
+        QMetaObject::invokeMethod(parentDocument(), "reportLoadFailure");
+        loaded = QImage(parentDocument()->imageSize(), QImage::Format_ARGB32);
+        loaded.fill(Qt::transparent);
+    }
+    else if ( loaded.format() == QImage::Format_Indexed8 && parentDocument()->indexedColors() )
+    {
+        // Document::remapColors() doesn't update images before they are loaded
+        loaded.setColorTable(parentDocument()->colorTable());
+    }
+    image_ = loaded;
+}
+
 const Frame* Image::frame() const
 {
     return frame_;
@@ -98,6 +168,7 @@ Document* Image::parentDocument() const
 
 void Image::beginPainting(const QString& text)
 {
+    ensureLoaded();
     if ( command_ )
     {
         /// \todo make it so they'll merge
@@ -110,43 +181,156 @@ void Image::endPainting()
 {
     if ( command_ )
     {
-        command_->setAfterImage(image_);
-        parentDocument()->pushCommand(command_);
+        // Cleared first so the notification from the command reports
+        // the paint operation as finished
+        command::ChangeImage* command = command_;
         command_ = nullptr;
+        command->setAfterImage(image_);
+        parentDocument()->pushCommand(command);
     }
 }
 
-void Image::setColors()
+bool Image::isPainting() const
+{
+    return command_ != nullptr;
+}
+
+void Image::markDirty(const QRect& rect)
 {
-    if ( parentDocument()->indexedColors() )
+    QRect dirty = rect.intersected(image_.rect());
+    if ( dirty.isEmpty() )
+        return;
+
+    revision_ = next_revision++;
+    if ( command_ )
+        command_->addDirtyRect(dirty);
+    emit parentDocument()->imageEdited(this, dirty);
+}
+
+QImage Image::convertColors() const
+{
+    ensureLoaded();
+    const Document* document = parentDocument();
+
+    if ( !document->indexedColors() )
     {
-        auto cmd = new command::ChangeImage(tr("Convert Image"), this, image_);
-        image_.setColorTable(parentDocument()->colorTable());
-        if ( image_.format() != QImage::Format_Indexed8 )
-            image_.convertToFormat(QImage::Format_Indexed8 ,
-                Qt::AutoColor|Qt::DiffuseDither|Qt::DiffuseAlphaDither);
-        cmd->setAfterImage(image_);
-        parentDocument()->pushCommand(cmd);
+        if ( image_.format() == QImage::Format_Indexed8 )
+            return image_.convertToFormat(QImage::Format_ARGB32);
+        return QImage();
     }
-    else
+
+    const misc::Quantizer& quantizer = document->quantizer();
+    if ( quantizer.isNull() )
+        return QImage();
+
+    if ( image_.format() == QImage::Format_Indexed8 )
+    {
+        if ( image_.colorTable() == quantizer.colorTable() )
+            return QImage();
+
+        // The indices are preserved when they are all valid
+        if ( quantizer.colorTable().size() >= image_.colorCount() )
+        {
+            QImage result = image_;
+            result.setColorTable(quantizer.colorTable());
+            return result;
+        }
+    }
+
+    return quantizer.quantize(image_, document->dither());
+}
+
+QImage Image::remapColors(const QVector<int>& remap) const
+{
+    ensureLoaded();
+    if ( image_.format() != QImage::Format_Indexed8 )
+        return convertColors();
+
+    const misc::Quantizer& quantizer = parentDocument()->quantizer();
+    if ( quantizer.isNull() )
+        return QImage();
+
+    int count = quantizer.colorTable().size();
+    uchar lookup[256];
+    for ( int i = 0; i < 256; i++ )
     {
-        if ( image_.format() != QImage::Format_Indexed8 )
+        int index = i < remap.size() ? remap[i] : i;
+        if ( index < 0 || index >= count )
+            index = i < image_.colorCount() ? quantizer.index(image_.color(i)) : 0;
+        lookup[i] = index;
+    }
+
+    QImage result(image_.size(), QImage::Format_Indexed8);
+    result.setColorTable(quantizer.colorTable());
+    for ( int y = 0; y < image_.height(); y++ )
+    {
+        const uchar* in = image_.constScanLine(y);
+        uchar* out = result.scanLine(y);
+        for ( int x = 0; x < image_.width(); x++ )
+            out[x] = lookup[in[x]];
+    }
+    return result;
+}
+
+QImage Image::replaceColors(const QHash<QRgb, QRgb>& colors) const
+{
+    ensureLoaded();
+    if ( colors.isEmpty() || image_.format() == QImage::Format_Indexed8 )
+        return QImage();
+
+    // Shallow copy when the image is already in this format
+    QImage source = image_.convertToFormat(QImage::Format_ARGB32);
+    QImage result;
+    for ( int y = 0; y < source.height(); y++ )
+    {
+        const QRgb* in = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        for ( int x = 0; x < source.width(); x++ )
         {
-            auto cmd = new command::ChangeImage(tr("Convert Image"), this, image_);
-            image_.convertToFormat(QImage::Format_ARGB32);
-            cmd->setAfterImage(image_);
-            parentDocument()->pushCommand(cmd);
+            auto iter = colors.find(in[x]);
+            if ( iter == colors.end() )
+                continue;
+            // Only images with matching pixels are copied
+            if ( result.isNull() )
+                result = source.copy();
+            reinterpret_cast<QRgb*>(result.scanLine(y))[x] = *iter;
         }
     }
+    return result;
+}
+
+void Image::setColorTable(const QVector<QRgb>& colors)
+{
+    ensureLoaded();
+    if ( image_.format() != QImage::Format_Indexed8 || image_.colorTable() == colors )
+        return;
+
+    parentDocument()->pushCommand(command::newSetProperty(
+        tr("Change Colors"), image_.colorTable(), colors,
+        [this](const QVector<QRgb>& colors) {
+            image_.setColorTable(colors);
+            emit edited();
+    }));
+}
+
+void Image::applyColors(const QImage& converted)
+{
+    auto cmd = new command::ChangeImage(tr("Convert Image"), this, image_);
+    image_ = converted;
+    cmd->setAfterImage(image_);
+    parentDocument()->pushCommand(cmd);
 }
 
-void Image::parentDocumentSet(Document* doc)
+void Image::initColors()
 {
-    connect(doc, &Document::paletteChanged, this, &Image::setColors);
+    // No undo command as the image is being created
+    QImage converted = convertColors();
+    if ( !converted.isNull() )
+        image_ = converted;
 }
 
 void Image::resize(const QRect& new_rect)
 {
+    ensureLoaded();
     if ( new_rect == image_.rect() )
         return;
 
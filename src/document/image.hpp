@@ -23,6 +23,9 @@
 
 #include <QImage>
 #include <QColor>
+#include <QFuture>
+#include <QHash>
+#include <QSharedPointer>
 
 #include "frame.hpp"
 #include "command/change_image.hpp"
@@ -31,6 +34,30 @@ namespace document {
 
 class Layer;
 
+/**
+ * \brief Provides the pixels of an image that hasn't been loaded yet
+ */
+class ImageSource
+{
+public:
+    virtual ~ImageSource() {}
+
+    /**
+     * \brief Decodes the image
+     * \note Must be thread safe, it may be called from a background thread
+     */
+    virtual QImage load() const = 0;
+
+    /**
+     * \brief Image encoded as a binary chunk, if available without decoding
+     * \note Must be thread safe, it may be called from a background thread
+     */
+    virtual QByteArray encoded() const
+    {
+        return QByteArray();
+    }
+};
+
 /**
  * \brief Lead image, a single frame in a single layer
  */
@@ -63,6 +90,20 @@ public:
      */
     void endPainting();
 
+    /**
+     * \brief Whether a paint operation is in progress
+     */
+    bool isPainting() const;
+
+    /**
+     * \brief Notifies that the pixels in \p rect have been modified in place
+     *
+     * Used by tools that draw directly on image() during a paint operation
+     * and by undo commands. It changes revision() and emits
+     * Document::imageEdited(), but not edited().
+     */
+    void markDirty(const QRect& rect);
+
     /**
     * \brief Paints the image
     */
@@ -87,19 +128,99 @@ public:
      */
     void resize(const QRect& new_rect);
 
+    /**
+     * \brief Returns the image converted to the color mode of the document
+     *
+     * Returns a null image if no conversion is needed.
+     * Can be called concurrently on different images.
+     */
+    QImage convertColors() const;
+
+    /**
+     * \brief Returns the image with the pixel indices remapped after
+     *        palette entries have been added or removed
+     * \param remap Maps the old palette indices to the new ones,
+     *              pixels of removed entries get the closest remaining color
+     */
+    QImage remapColors(const QVector<int>& remap) const;
+
+    /**
+     * \brief Returns a full color image with the pixels matching a key
+     *        of \p colors replaced by its value
+     *
+     * Returns a null image if no pixel matches or the image is indexed.
+     * Can be called concurrently on different images.
+     */
+    QImage replaceColors(const QHash<QRgb, QRgb>& colors) const;
+
+    /**
+     * \brief Replaces the pixels with the result of convertColors(),
+     *        remapColors() or replaceColors()
+     */
+    void applyColors(const QImage& converted);
+
+    /**
+     * \brief Changes the colors of an indexed image without touching
+     *        its pixels, as an undoable command
+     */
+    void setColorTable(const QVector<QRgb>& colors);
+
+    /**
+     * \brief Defers loading the pixels until they are first needed
+     *
+     * The image will be loaded from \p source by image(), paint() or any
+     * editing operation. If that fails, the image is left transparent and
+     * the document reports it, see Document::damagedFile().
+     * Indexed images loaded into an indexed document take its colorTable().
+     */
+    void setSource(const QSharedPointer<ImageSource>& source);
+
+    /**
+     * \brief Whether the pixels are available without having to decode them
+     */
+    bool isLoaded() const;
+
+    /**
+     * \brief Source the pixels will be loaded from,
+     *        \b null if the image is loaded
+     */
+    QSharedPointer<ImageSource> source() const;
+
+    /**
+     * \brief Starts loading the pixels in a background thread
+     */
+    void prefetch();
+
+    /**
+     * \brief Identifies the current contents of the image
+     *
+     * It changes every time the pixels are modified and it's never shared
+     * between different images.
+     */
+    quint64 revision() const;
 
     void apply(Visitor& visitor) override;
     Document* parentDocument() const override;
 
-protected:
-    void parentDocumentSet(Document* doc) override;
-
 private:
-    void setColors();
-
-    QImage image_;
+    /**
+     * \brief Pixel data yet to be loaded, see setSource()
+     */
+    struct PendingLoad
+    {
+        QSharedPointer<ImageSource> source;
+        QFuture<QImage> future;
+        bool prefetching = false;
+    };
+
+    void initColors();
+    void ensureLoaded() const;
+
+    mutable QImage image_;
+    mutable PendingLoad* pending_ = nullptr;
     Frame* frame_;
     Layer* layer_;
+    quint64 revision_;
     command::ChangeImage* command_ = nullptr;
 };
 
@@ -23,6 +23,7 @@
 #include "layer.hpp"
 #include "document.hpp"
 #include "visitor.hpp"
+#include "command/add_element.hpp"
 #include "command/move_child_layers.hpp"
 #include "command/set_property.hpp"
 
@@ -148,6 +149,42 @@ Image* Layer::addFrameImage(const QImage& qimage)
     return image;
 }
 
+Image* Layer::insertFrameImage(const QImage& qimage, Frame* frame)
+{
+    Image* image = new Image(this, qimage, frame);
+    owner_->pushCommand(command::newAddElement(
+        tr("Add Image"), image,
+        [this, image]{
+            frames_.push_back(image);
+            emit edited();
+        },
+        [this, image]{
+            frames_.removeOne(image);
+            emit edited();
+        }
+    ));
+    return image;
+}
+
+void Layer::removeFrameImage(Image* image)
+{
+    int index = frames_.indexOf(image);
+    if ( index == -1 )
+        return;
+
+    owner_->pushCommand(command::newRemoveElement(
+        tr("Remove Image"), image,
+        [this, image, index]{
+            frames_.insert(index, image);
+            emit edited();
+        },
+        [this, image]{
+            frames_.removeOne(image);
+            emit edited();
+        }
+    ));
+}
+
 void Layer::apply(Visitor& visitor)
 {
     if ( visitor.enter(*this) )
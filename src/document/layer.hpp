@@ -113,6 +113,19 @@ public:
 
     Image* addFrameImage(const QImage& image);
 
+    /**
+     * \brief Adds an image shown in \p frame, as an undoable command
+     * \returns The created image, owned by the command while it's undone
+     */
+    Image* insertFrameImage(const QImage& image, Frame* frame);
+
+    /**
+     * \brief Removes an image created with addFrameImage()
+     *
+     * The image is deleted when the command removing it is discarded.
+     */
+    void removeFrameImage(Image* image);
+
     void apply(Visitor& visitor) override;
     Document* parentDocument() const override;
 
@@ -190,6 +190,68 @@ private:
     QStack<qreal> alpha;
 };
 
+/**
+ * \brief Makes sure all images have been loaded
+ *
+ * Pending images are loaded in parallel
+ */
+class LoadImages : public Visitor
+{
+public:
+    bool enter(Document& document) override
+    {
+        return true;
+    }
+
+    void leave(Document& document) override
+    {
+        for ( auto image : pending )
+            image->image();
+        pending.clear();
+    }
+
+    bool enter(Layer& layer) override
+    {
+        return true;
+    }
+
+    void visit(Image& image) override
+    {
+        if ( !image.isLoaded() )
+        {
+            image.prefetch();
+            pending.push_back(&image);
+        }
+    }
+
+private:
+    QList<Image*> pending;
+};
+
+/**
+ * \brief Lists all the images in the document
+ */
+class CollectImages : public Visitor
+{
+public:
+    bool enter(Document& document) override
+    {
+        return true;
+    }
+
+    bool enter(Layer& layer) override
+    {
+        return true;
+    }
+
+    void visit(Image& image) override
+    {
+        images.push_back(&image);
+    }
+
+    QList<Image*> images;
+};
+
 /**
  * \brief Searches for a layer by name
  */
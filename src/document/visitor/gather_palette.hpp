@@ -22,13 +22,18 @@
 #define PIXEL_CAYMAN_DOCUMENT_VISITOR_GETHER_PALETTE_HPP
 
 #include "document/visitor.hpp"
-#include <QSet>
+#include "misc/color_histogram.hpp"
+#include <QtConcurrent>
 
 namespace document {
 namespace visitor {
 
 /**
  * \brief Creates a palette from the colors used in the document
+ *
+ * The images are scanned in parallel once the whole document has been
+ * visited, each thread counts the colors in a band of rows and the
+ * results are merged at the end.
  */
 class GatherPalette : public Visitor
 {
@@ -36,14 +41,75 @@ public:
 
     color_widgets::ColorPalette palette() const
     {
-        return color_widgets::ColorPalette::fromColorTable(colors);
+        return color_widgets::ColorPalette::fromColorTable(histogram_.colors());
+    }
+
+    /**
+     * \brief Number of pixels using each color,
+     *        useful to reduce the palette to the most used colors
+     */
+    const misc::ColorHistogram& histogram() const
+    {
+        return histogram_;
+    }
+
+    /**
+     * \brief Counts the colors of \p images in parallel
+     * \note Doesn't access the document, so it can run in a worker thread
+     */
+    static misc::ColorHistogram gather(const QList<QImage>& images)
+    {
+        struct Band
+        {
+            QImage image;
+            int begin;
+            int end;
+            misc::ColorHistogram histogram;
+        };
+
+        const int rows_per_band = 128;
+        QVector<Band> bands;
+        for ( QImage img : images )
+        {
+            if ( img.format() != QImage::Format_Indexed8 &&
+                 img.format() != QImage::Format_ARGB32 &&
+                 img.format() != QImage::Format_RGB32 )
+                img = img.convertToFormat(QImage::Format_ARGB32);
+
+            for ( int row = 0; row < img.height(); row += rows_per_band )
+                bands.push_back({img, row, qMin(row + rows_per_band, img.height()), {}});
+        }
+
+        QtConcurrent::blockingMap(bands, [](Band& band) {
+            band.histogram.add(band.image, band.begin, band.end);
+        });
+
+        misc::ColorHistogram histogram;
+        for ( const auto& band : bands )
+            histogram.merge(band.histogram);
+        return histogram;
     }
 
     bool enter(Document& document) override
     {
+        images.clear();
+        histogram_ = misc::ColorHistogram();
         return true;
     }
 
+    void leave(Document& document) override
+    {
+        // Loading lazy images isn't safe from multiple threads
+        LoadImages loader;
+        document.apply(loader);
+
+        QList<QImage> pixels;
+        for ( auto image : images )
+            pixels.push_back(image->image());
+        histogram_ = gather(pixels);
+        images.clear();
+    }
+
     bool enter(Layer& layer) override
     {
         return true;
@@ -51,30 +117,12 @@ public:
 
     void visit(Image& image) override
     {
-        if ( image.image().format() == QImage::Format_Indexed8 )
-        {
-            for ( auto color : image.image().colorTable() )
-                insertColor(color);
-            return;
-        }
-        // The temporary created by convertToFormat will have its lifetime
-        // extended to the lifetime of img since it's a const reference
-        const QImage& img = image.image().format() == QImage::Format_ARGB32 ?
-            image.image() : image.image().convertToFormat(QImage::Format_ARGB32);
-        const QRgb* data = reinterpret_cast<const QRgb*>(img.constBits());
-        for ( int i = 0; i < img.byteCount() / sizeof(QRgb); i++ )
-                colors.insert(data[i]);
+        images.push_back(&image);
     }
 
 private:
-    void insertColor(QRgb color)
-    {
-        auto it = std::lower_bound(colors.begin(), colors.end());
-        if ( it == colors.end() || *it != color )
-            colors.insert(it, color);
-    }
-
-    QVector<QRgb> colors;
+    QList<Image*> images;
+    misc::ColorHistogram histogram_;
 };
 
 } // namespace visitor
@@ -0,0 +1,118 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "animated.hpp"
+
+#include <cstring>
+#include <QPainter>
+#include <QtConcurrent>
+#include "document/visitor.hpp"
+
+namespace io {
+
+QImage renderFrame(document::DocumentElement* root, document::Frame* frame,
+                   const QSize& size, bool full_alpha)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    document::visitor::Paint paint(frame, &painter, full_alpha);
+    root->apply(paint);
+    painter.end();
+    return image.convertToFormat(QImage::Format_ARGB32);
+}
+
+QVector<AnimatedFrame> renderAnimation(document::Document* document,
+                                       const QString& name, bool full_alpha)
+{
+    document::Animation* animation = nullptr;
+    if ( !name.isEmpty() )
+        animation = document->animation(name);
+    for ( auto anim : document->animations() )
+        if ( !animation && anim->count() )
+            animation = anim;
+
+    struct Job
+    {
+        document::Frame* frame;
+        AnimatedFrame result;
+    };
+    QVector<Job> jobs;
+    if ( animation && animation->count() )
+    {
+        int duration = 1000 / qMax(1, animation->framesPerSecond());
+        for ( int i = 0; i < animation->count(); i++ )
+            jobs.push_back({animation->frame(i), {QImage(), duration}});
+    }
+    else
+    {
+        jobs.push_back({nullptr, {QImage(), 0}});
+    }
+
+    QSize size = document->imageSize();
+    QtConcurrent::blockingMap(jobs, [document, size, full_alpha](Job& job) {
+        job.result.image = renderFrame(document, job.frame, size, full_alpha);
+    });
+
+    QVector<AnimatedFrame> frames;
+    frames.reserve(jobs.size());
+    for ( const Job& job : jobs )
+        frames.push_back(job.result);
+    return frames;
+}
+
+QRect differenceRect(const QImage& a, const QImage& b)
+{
+    int bytes = a.depth() / 8;
+    int line_size = a.width() * bytes;
+    int top = -1;
+    int bottom = -1;
+    int left = a.width();
+    int right = -1;
+
+    for ( int y = 0; y < a.height(); y++ )
+    {
+        const uchar* line_a = a.constScanLine(y);
+        const uchar* line_b = b.constScanLine(y);
+        if ( std::memcmp(line_a, line_b, line_size) == 0 )
+            continue;
+
+        int first = 0;
+        while ( std::memcmp(line_a + first * bytes, line_b + first * bytes, bytes) == 0 )
+            first++;
+        int last = a.width() - 1;
+        while ( last > right && std::memcmp(line_a + last * bytes, line_b + last * bytes, bytes) == 0 )
+            last--;
+
+        left = qMin(left, first);
+        right = qMax(right, last);
+        if ( top == -1 )
+            top = y;
+        bottom = y;
+    }
+
+    if ( top == -1 )
+        return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+} // namespace io
@@ -0,0 +1,65 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_IO_ANIMATED_HPP
+#define PIXEL_CAYMAN_IO_ANIMATED_HPP
+
+#include <QImage>
+#include <QVector>
+#include "document/document.hpp"
+
+namespace io {
+
+/**
+ * \brief Frame rendered for the animated bitmap formats
+ */
+struct AnimatedFrame
+{
+    QImage image;       ///< Whole canvas, Format_ARGB32
+    int duration = 0;   ///< Milliseconds
+};
+
+/**
+ * \brief Paints \p root as it appears in \p frame on a transparent canvas
+ * \returns An image of the given \p size in Format_ARGB32
+ * \note Safe to call from multiple threads once all lazy images have been
+ *       loaded, AbstractFormat::save() loads them before saving
+ */
+QImage renderFrame(document::DocumentElement* root, document::Frame* frame,
+                   const QSize& size, bool full_alpha);
+
+/**
+ * \brief Renders the frames of an animation in parallel
+ * \param name Name of the animation, if empty the first one with frames is used
+ *
+ * Documents without animations result in a single frame.
+ * Lazy images must have been loaded, see renderFrame().
+ */
+QVector<AnimatedFrame> renderAnimation(document::Document* document,
+                                       const QString& name, bool full_alpha);
+
+/**
+ * \brief Bounding rect of the pixels which differ between two images
+ *        with the same size and format
+ */
+QRect differenceRect(const QImage& a, const QImage& b);
+
+} // namespace io
+#endif // PIXEL_CAYMAN_IO_ANIMATED_HPP
@@ -0,0 +1,290 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "apng.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <numeric>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include "animated.hpp"
+
+namespace io {
+
+namespace {
+
+/**
+ * \brief Image data stored in the file
+ */
+struct Block
+{
+    QRect rect;
+    int delay;          ///< Milliseconds
+    bool blend;         ///< Whether it's blended over the previous frame
+    QByteArray data;    ///< Compressed image data
+};
+
+quint32 crc32(const QByteArray& data)
+{
+    static const std::array<quint32, 256> table = []{
+        std::array<quint32, 256> table;
+        for ( quint32 i = 0; i < 256; i++ )
+        {
+            quint32 crc = i;
+            for ( int bit = 0; bit < 8; bit++ )
+                crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+            table[i] = crc;
+        }
+        return table;
+    }();
+
+    quint32 crc = 0xffffffff;
+    for ( char byte : data )
+        crc = table[(crc ^ uchar(byte)) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+void writeUint32(QByteArray& data, quint32 value)
+{
+    uchar bytes[4];
+    qToBigEndian(value, bytes);
+    data.append(reinterpret_cast<const char*>(bytes), 4);
+}
+
+void writeUint16(QByteArray& data, quint16 value)
+{
+    uchar bytes[2];
+    qToBigEndian(value, bytes);
+    data.append(reinterpret_cast<const char*>(bytes), 2);
+}
+
+void writeChunk(QIODevice* device, const char* type, const QByteArray& data)
+{
+    QByteArray chunk;
+    writeUint32(chunk, data.size());
+    chunk.append(type, 4);
+    chunk.append(data);
+    writeUint32(chunk, crc32(chunk.mid(4)));
+    device->write(chunk);
+}
+
+int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if ( pa <= pb && pa <= pc )
+        return a;
+    if ( pb <= pc )
+        return b;
+    return c;
+}
+
+/**
+ * \brief Filters RGBA rows and compresses them into a zlib stream
+ *
+ * Each row uses the filter which minimizes the sum of the absolute
+ * differences, as recommended by the PNG specification.
+ */
+QByteArray compressRows(const QByteArray& rgba, int width, int height)
+{
+    int stride = width * 4;
+    QByteArray filtered;
+    filtered.reserve(height * (stride + 1));
+    QByteArray zero(stride, 0);
+    QByteArray candidate(stride, 0);
+    QByteArray best(stride, 0);
+
+    for ( int y = 0; y < height; y++ )
+    {
+        const uchar* line = reinterpret_cast<const uchar*>(rgba.constData()) + y * stride;
+        const uchar* up = y > 0 ? line - stride : reinterpret_cast<const uchar*>(zero.constData());
+        int best_filter = 0;
+        int best_sum = -1;
+
+        for ( int filter = 0; filter < 5; filter++ )
+        {
+            uchar* out = reinterpret_cast<uchar*>(candidate.data());
+            int sum = 0;
+            for ( int x = 0; x < stride; x++ )
+            {
+                int a = x >= 4 ? line[x-4] : 0;
+                int b = up[x];
+                int c = x >= 4 ? up[x-4] : 0;
+                int predicted = 0;
+                switch ( filter )
+                {
+                    case 1: predicted = a; break;
+                    case 2: predicted = b; break;
+                    case 3: predicted = (a + b) / 2; break;
+                    case 4: predicted = paeth(a, b, c); break;
+                }
+                out[x] = uchar(line[x] - predicted);
+                sum += std::abs(int(qint8(out[x])));
+            }
+
+            if ( best_sum == -1 || sum < best_sum )
+            {
+                best_sum = sum;
+                best_filter = filter;
+                std::swap(best, candidate);
+            }
+        }
+
+        filtered.append(char(best_filter));
+        filtered.append(best);
+    }
+
+    // Strip the uncompressed size added by qCompress
+    return qCompress(filtered).mid(4);
+}
+
+} // namespace
+
+bool FormatApng::onSave(document::Document* input, QIODevice* device)
+{
+    QVector<AnimatedFrame> frames = renderAnimation(input,
+        setting<QString>("animation", input), setting("full_alpha", input, false));
+    bool loop = setting("loop", input, true);
+
+    int count = frames.size();
+    QVector<int> frame_indices(count);
+    std::iota(frame_indices.begin(), frame_indices.end(), 0);
+    QVector<QRect> changed(count);
+    QtConcurrent::blockingMap(frame_indices, [&](int i) {
+        changed[i] = i == 0 ? input->imageRect()
+                            : differenceRect(frames[i-1].image, frames[i].image);
+    });
+
+    QVector<Block> blocks;
+    QVector<int> block_frames;
+    for ( int i = 0; i < count; i++ )
+    {
+        if ( changed[i].isEmpty() && !blocks.isEmpty() )
+        {
+            blocks.back().delay += frames[i].duration;
+            continue;
+        }
+        Block block;
+        block.rect = changed[i];
+        block.delay = frames[i].duration;
+        block.blend = false;
+        blocks.push_back(block);
+        block_frames.push_back(i);
+    }
+
+    QVector<int> block_indices(blocks.size());
+    std::iota(block_indices.begin(), block_indices.end(), 0);
+    QtConcurrent::blockingMap(block_indices, [&](int b) {
+        Block& block = blocks[b];
+        int frame = block_frames[b];
+        const QImage& image = frames[frame].image;
+        const QImage* previous = frame > 0 ? &frames[frame-1].image : nullptr;
+        QRect rect = block.rect;
+
+        // Blending can replace a pixel only if it's opaque or drawn over nothing
+        block.blend = previous != nullptr;
+        for ( int y = rect.top(); y <= rect.bottom() && block.blend; y++ )
+        {
+            const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            const QRgb* previous_line = reinterpret_cast<const QRgb*>(previous->constScanLine(y));
+            for ( int x = rect.left(); x <= rect.right(); x++ )
+            {
+                if ( line[x] != previous_line[x] && qAlpha(line[x]) != 255 &&
+                     qAlpha(previous_line[x]) != 0 )
+                {
+                    block.blend = false;
+                    break;
+                }
+            }
+        }
+
+        QByteArray rgba(rect.width() * rect.height() * 4, 0);
+        uchar* out = reinterpret_cast<uchar*>(rgba.data());
+        for ( int y = rect.top(); y <= rect.bottom(); y++ )
+        {
+            const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            const QRgb* previous_line = block.blend ?
+                reinterpret_cast<const QRgb*>(previous->constScanLine(y)) : nullptr;
+            for ( int x = rect.left(); x <= rect.right(); x++, out += 4 )
+            {
+                if ( previous_line && line[x] == previous_line[x] )
+                    continue;
+                out[0] = qRed(line[x]);
+                out[1] = qGreen(line[x]);
+                out[2] = qBlue(line[x]);
+                out[3] = qAlpha(line[x]);
+            }
+        }
+        block.data = compressRows(rgba, rect.width(), rect.height());
+    });
+
+    device->write("\x89PNG\r\n\x1a\n", 8);
+
+    QByteArray header;
+    writeUint32(header, input->imageSize().width());
+    writeUint32(header, input->imageSize().height());
+    header.append("\x08\x06\x00\x00\x00", 5);
+    writeChunk(device, "IHDR", header);
+
+    QByteArray control;
+    writeUint32(control, blocks.size());
+    writeUint32(control, loop ? 0 : 1);
+    writeChunk(device, "acTL", control);
+
+    quint32 sequence = 0;
+    for ( int b = 0; b < blocks.size(); b++ )
+    {
+        const Block& block = blocks[b];
+        QByteArray frame_control;
+        writeUint32(frame_control, sequence++);
+        writeUint32(frame_control, block.rect.width());
+        writeUint32(frame_control, block.rect.height());
+        writeUint32(frame_control, block.rect.x());
+        writeUint32(frame_control, block.rect.y());
+        writeUint16(frame_control, qMin(block.delay, 0xffff));
+        writeUint16(frame_control, 1000);
+        frame_control.append(char(0));
+        frame_control.append(char(block.blend ? 1 : 0));
+        writeChunk(device, "fcTL", frame_control);
+
+        if ( b == 0 )
+        {
+            writeChunk(device, "IDAT", block.data);
+        }
+        else
+        {
+            QByteArray frame_data;
+            writeUint32(frame_data, sequence++);
+            frame_data.append(block.data);
+            writeChunk(device, "fdAT", frame_data);
+        }
+    }
+
+    writeChunk(device, "IEND", QByteArray());
+    return true;
+}
+
+} // namespace io
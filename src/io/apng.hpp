@@ -0,0 +1,54 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_IO_APNG_HPP
+#define PIXEL_CAYMAN_IO_APNG_HPP
+
+#include "formats.hpp"
+
+namespace io {
+
+/**
+ * \brief Exports an animation as an animated PNG
+ *
+ * Each frame only stores the area which changed since the previous one,
+ * when possible it's alpha blended over the previous frame so unchanged
+ * pixels can be stored as transparent.
+ *
+ * Settings:
+ *  - \c animation   Name of the animation, if empty the first one with frames
+ *  - \c loop        Whether the animation repeats (default \b true)
+ *  - \c full_alpha  Whether to ignore layer visibility and opacity
+ */
+class FormatApng : public AbstractFormat
+{
+    Q_DECLARE_TR_FUNCTIONS(FormatApng)
+public:
+    QString id() const override { return "apng"; }
+    QString name() const override { return tr("Animated PNG"); }
+    QStringList extensions(Action action) const override { return {"apng"}; }
+    bool canSave() const override { return true; }
+
+protected:
+    bool onSave(document::Document* input, QIODevice* device) override;
+};
+
+} // namespace io
+#endif // PIXEL_CAYMAN_IO_APNG_HPP
@@ -0,0 +1,377 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "autosave.hpp"
+
+#include <QBuffer>
+#include <QDir>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "binary.hpp"
+#include "cayman/data.hpp"
+
+namespace io {
+
+static const QByteArray journal_magic("CAYMANJ\0", 8);
+static constexpr quint32 journal_version = 1;
+
+/**
+ * \brief Directory containing the journals of all the documents
+ */
+static QString journalRoot()
+{
+    QString root = cayman::data().tempDir() + "autosave/";
+    QDir().mkpath(root);
+    return root;
+}
+
+/**
+ * \brief Image chunk to be written by the worker thread
+ */
+struct JournalChunk
+{
+    QString file;
+    QImage image;
+    QSharedPointer<document::ImageSource> source;   ///< Used if image is null
+};
+
+/**
+ * \brief Data captured from a document to be written by the worker thread
+ */
+struct JournalSnapshot
+{
+    QString path;
+    QString file_name;
+    QByteArray tree;
+    QStringList files;                      ///< Chunk file for each image
+    QList<JournalChunk> dirty;              ///< Chunks that need to be written
+};
+
+/**
+ * \brief Serializes the tree like the binary format but only collects the
+ * images that aren't already in the journal instead of encoding them all
+ */
+class SnapshotVisitor : public SaverBinary
+{
+public:
+    SnapshotVisitor(JournalSnapshot& snapshot, const QSet<QString>& written)
+        : SaverBinary(binary::Compression::Zlib),
+          snapshot(snapshot), written(written)
+    {}
+
+protected:
+    quint32 addChunk(document::Image& image) override
+    {
+        // Images that aren't loaded are identified by their source,
+        // so they don't need to be decoded
+        auto source = image.source();
+        qint64 key = source ? qint64(reinterpret_cast<quintptr>(source.data()))
+                           : image.image().cacheKey();
+        QHash<qint64, QString>& shared_chunks = source ? shared_sources : shared_images;
+
+        // Images sharing their pixels share the chunk as well
+        auto shared = shared_chunks.find(key);
+        if ( shared != shared_chunks.end() )
+        {
+            snapshot.files.push_back(*shared);
+            return snapshot.files.size() - 1;
+        }
+
+        // Revisions are unique so they identify the contents of the file
+        QString file = QString::number(image.revision(), 16) + ".chunk";
+        if ( !written.contains(file) )
+        {
+            JournalChunk chunk;
+            chunk.file = file;
+            if ( source )
+                chunk.source = source;
+            else
+                chunk.image = image.image();
+            snapshot.dirty.push_back(chunk);
+        }
+        snapshot.files.push_back(file);
+        shared_chunks.insert(key, file);
+        return snapshot.files.size() - 1;
+    }
+
+private:
+    JournalSnapshot& snapshot;
+    const QSet<QString>& written;
+    QHash<qint64, QString> shared_images;   ///< QImage::cacheKey() -> file
+    QHash<qint64, QString> shared_sources;  ///< Pending image source -> file
+};
+
+/**
+ * \brief Writes the new chunks and the manifest, runs in a worker thread
+ */
+static bool writeJournal(JournalSnapshot snapshot)
+{
+    QDir dir(snapshot.path);
+
+    for ( const auto& chunk : snapshot.dirty )
+    {
+        QSaveFile file(dir.filePath(chunk.file));
+        if ( !file.open(QIODevice::WriteOnly) )
+            return false;
+
+        // Chunks of images that haven't been loaded are copied as they are
+        QByteArray data;
+        if ( chunk.source )
+            data = chunk.source->encoded();
+        if ( data.isEmpty() )
+        {
+            QImage image = chunk.source ? chunk.source->load() : chunk.image;
+            data = binary::encodeChunk(image, binary::Compression::Zlib);
+        }
+        file.write(data);
+        if ( !file.commit() )
+            return false;
+    }
+
+    QSaveFile manifest(dir.filePath("manifest"));
+    if ( !manifest.open(QIODevice::WriteOnly) )
+        return false;
+    QDataStream out(&manifest);
+    out.setVersion(QDataStream::Qt_5_0);
+    out.writeRawData(journal_magic.constData(), journal_magic.size());
+    out << journal_version << snapshot.file_name << snapshot.tree << snapshot.files;
+    if ( out.status() != QDataStream::Ok || !manifest.commit() )
+        return false;
+
+    // Remove images that are no longer referenced
+    QSet<QString> used = snapshot.files.toSet();
+    for ( const QString& name : dir.entryList({"*.chunk"}, QDir::Files) )
+        if ( !used.contains(name) )
+            dir.remove(name);
+
+    return true;
+}
+
+/**
+ * \brief Rebuilds a document from a journal directory
+ * \return \b nullptr if the journal can't be read
+ */
+static document::Document* loadJournal(const QDir& dir)
+{
+    QFile manifest(dir.filePath("manifest"));
+    if ( !manifest.open(QIODevice::ReadOnly) )
+        return nullptr;
+
+    QDataStream in(&manifest);
+    in.setVersion(QDataStream::Qt_5_0);
+    QByteArray magic(journal_magic.size(), '\0');
+    in.readRawData(magic.data(), magic.size());
+    quint32 version;
+    QString file_name;
+    QByteArray tree;
+    QStringList files;
+    in >> version >> file_name >> tree >> files;
+    if ( magic != journal_magic || version > journal_version ||
+         in.status() != QDataStream::Ok )
+        return nullptr;
+
+    // Reassemble a binary .mela file in memory
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    bool ok = true;
+    binary::writeContainer(&buffer, tree, files.size(), [&dir, &files, &ok](int i) {
+        QFile chunk(dir.filePath(files[i]));
+        if ( !chunk.open(QIODevice::ReadOnly) )
+        {
+            ok = false;
+            return QByteArray();
+        }
+        return chunk.readAll();
+    });
+    buffer.close();
+    if ( !ok )
+        return nullptr;
+
+    buffer.open(QIODevice::ReadOnly);
+    FormatBinaryMela format;
+    document::Document* document = format.open(&buffer);
+    if ( document )
+    {
+        document->setFileName(file_name);
+        document->formatSettings().setPreferred(nullptr);
+    }
+    return document;
+}
+
+class Autosave::Journal
+{
+public:
+    explicit Journal(document::Document* document)
+        : document(document),
+          directory(journalRoot() + "journal-XXXXXX"),
+          lock(directory.path() + "/lock")
+    {
+        if ( directory.isValid() )
+            lock.tryLock(0);
+
+        connection = QObject::connect(&document->undoStack(), &QUndoStack::indexChanged,
+            [this]{ changes++; });
+    }
+
+    ~Journal()
+    {
+        QObject::disconnect(connection);
+        writer.waitForFinished();
+    }
+
+    /**
+     * \brief Whether the previous snapshot is still being written
+     */
+    bool busy()
+    {
+        if ( !writing )
+            return false;
+
+        if ( !writer.isFinished() )
+            return true;
+
+        writing = false;
+        if ( writer.result() )
+            written = pending;
+        else
+            written.clear();
+        pending.clear();
+        return false;
+    }
+
+    document::Document* document;
+    QTemporaryDir directory;
+    QLockFile lock;
+    QMetaObject::Connection connection;
+
+    QFuture<bool> writer;
+    bool writing = false;
+
+    int changes = 0;            ///< Number of changes to the undo stack
+    int saved_changes = 0;      ///< Value of changes at the last snapshot
+    QSet<QString> written;      ///< Chunk files known to be on disk
+    QSet<QString> pending;      ///< Chunk files of the write in progress
+};
+
+Autosave::Autosave(QObject* parent)
+    : QObject(parent)
+{
+    connect(&timer, &QTimer::timeout, this, &Autosave::autosave);
+}
+
+Autosave::~Autosave()
+{
+    qDeleteAll(journals);
+}
+
+void Autosave::addDocument(document::Document* document)
+{
+    if ( !journals.contains(document) )
+        journals.insert(document, new Journal(document));
+}
+
+void Autosave::removeDocument(document::Document* document)
+{
+    delete journals.take(document);
+}
+
+int Autosave::interval() const
+{
+    return timer.isActive() ? timer.interval() / 1000 : 0;
+}
+
+void Autosave::setInterval(int seconds)
+{
+    if ( seconds > 0 )
+        timer.start(seconds * 1000);
+    else
+        timer.stop();
+}
+
+void Autosave::autosave()
+{
+    for ( Journal* journal : journals )
+    {
+        if ( !journal->directory.isValid() || journal->busy() )
+            continue;
+
+        if ( journal->changes == journal->saved_changes )
+            continue;
+        journal->saved_changes = journal->changes;
+
+        document::Document* document = journal->document;
+        if ( document->undoStack().isClean() )
+        {
+            // The file on disk is up to date, nothing to recover
+            QDir(journal->directory.path()).remove("manifest");
+            continue;
+        }
+
+        JournalSnapshot snapshot;
+        snapshot.path = journal->directory.path();
+        snapshot.file_name = document->fileName();
+        SnapshotVisitor visitor(snapshot, journal->written);
+        document->apply(visitor);
+        snapshot.tree = visitor.treeData();
+
+        journal->pending = snapshot.files.toSet();
+        journal->writer = QtConcurrent::run(writeJournal, snapshot);
+        journal->writing = true;
+    }
+}
+
+QList<document::Document*> Autosave::recover()
+{
+    QList<document::Document*> documents;
+
+    QDir root(journalRoot());
+    for ( const QString& name : root.entryList({"journal-*"}, QDir::Dirs|QDir::NoDotAndDotDot) )
+    {
+        QDir dir(root.filePath(name));
+
+        // Journals of running instances are still locked
+        QLockFile lock(dir.filePath("lock"));
+        if ( !lock.tryLock(0) )
+            continue;
+
+        if ( dir.exists("manifest") )
+        {
+            document::Document* document = loadJournal(dir);
+            if ( !document )
+                continue;
+            // Ensures the recovered changes are treated as unsaved
+            document->pushCommand(new QUndoCommand(tr("Recovered from autosave")));
+            documents.push_back(document);
+        }
+
+        lock.unlock();
+        dir.removeRecursively();
+    }
+
+    return documents;
+}
+
+} // namespace io
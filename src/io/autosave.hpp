@@ -0,0 +1,84 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_IO_AUTOSAVE_HPP
+#define PIXEL_CAYMAN_IO_AUTOSAVE_HPP
+
+#include <QHash>
+#include <QTimer>
+#include "document/document.hpp"
+
+namespace io {
+
+/**
+ * \brief Periodically saves modified documents to a recovery journal
+ *
+ * Each document has a directory under cayman::Data::tempDir() with one
+ * file per image and a manifest with the layer tree.
+ * Documents are only snapshotted on the GUI thread (images are shared
+ * copy-on-write), images are encoded and written by a worker thread and
+ * only those modified since the previous autosave are written again.
+ */
+class Autosave : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Autosave(QObject* parent = nullptr);
+    ~Autosave();
+
+    /**
+     * \brief Starts autosaving \p document
+     */
+    void addDocument(document::Document* document);
+
+    /**
+     * \brief Stops autosaving \p document and discards its journal
+     */
+    void removeDocument(document::Document* document);
+
+    /**
+     * \brief Seconds between autosaves, 0 if autosave is disabled
+     */
+    int interval() const;
+    void setInterval(int seconds);
+
+    /**
+     * \brief Loads the documents left by a session that didn't exit cleanly
+     *
+     * The recovered journals are removed.
+     */
+    static QList<document::Document*> recover();
+
+public slots:
+    /**
+     * \brief Snapshots all the modified documents
+     */
+    void autosave();
+
+private:
+    class Journal;
+
+    QHash<document::Document*, Journal*> journals;
+    QTimer timer;
+};
+
+} // namespace io
+#endif // PIXEL_CAYMAN_IO_AUTOSAVE_HPP
@@ -0,0 +1,593 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "binary.hpp"
+
+#include <cstring>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace io {
+
+namespace binary {
+
+const QByteArray magic("CAYMANB\0", 8);
+const QByteArray index_magic("CAYMANBI", 8);
+
+QByteArray encodeChunk(QImage image, Compression compression)
+{
+    QByteArray pixels = QByteArray::fromRawData(
+        reinterpret_cast<const char*>(image.constBits()), image.byteCount());
+
+    if ( compression == Compression::Zlib )
+    {
+        QByteArray compressed = qCompress(pixels);
+        if ( compressed.size() < pixels.size() )
+            pixels = compressed;
+        else
+            compression = Compression::None;
+    }
+
+    QByteArray chunk;
+    QDataStream out(&chunk, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint8(compression) << qint32(image.width()) << qint32(image.height())
+        << quint32(image.format()) << image.colorTable() << pixels;
+    return chunk;
+}
+
+QImage decodeChunk(const uchar* data, quint64 size, const QSize& max_size)
+{
+    QByteArray raw = QByteArray::fromRawData(reinterpret_cast<const char*>(data), size);
+    QDataStream in(raw);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint8 compression;
+    qint32 width, height;
+    quint32 format;
+    quint32 color_count;
+    in >> compression >> width >> height >> format >> color_count;
+    if ( in.status() != QDataStream::Ok || format >= QImage::NImageFormats ||
+         width <= 0 || width > max_size.width() ||
+         height <= 0 || height > max_size.height() )
+        return QImage();
+
+    // Same layout as QVector<QRgb>, but the count is checked before
+    // allocating: an indexed image can't have more than 256 colors
+    if ( color_count > 256 )
+        return QImage();
+    QVector<QRgb> colors(color_count);
+    for ( QRgb& color : colors )
+        in >> color;
+
+    quint32 length;
+    in >> length;
+    if ( in.status() != QDataStream::Ok )
+        return QImage();
+
+    // Read the pixels straight from the input buffer
+    if ( length == 0xffffffff )
+        length = 0;
+    quint64 pixels_offset = in.device()->pos();
+    if ( pixels_offset + length > size )
+        return QImage();
+    const uchar* pixels = data + pixels_offset;
+
+    QByteArray uncompressed;
+    if ( compression == quint8(Compression::Zlib) )
+    {
+        uncompressed = qUncompress(pixels, length);
+        pixels = reinterpret_cast<const uchar*>(uncompressed.constData());
+        length = uncompressed.size();
+    }
+    else if ( compression != quint8(Compression::None) )
+    {
+        return QImage();
+    }
+
+    QImage image(width, height, QImage::Format(format));
+    if ( image.isNull() || quint32(image.byteCount()) != length )
+        return QImage();
+    std::memcpy(image.bits(), pixels, length);
+    image.setColorTable(colors);
+    return image;
+}
+
+bool writeContainer(QIODevice* device, const QByteArray& tree, int chunk_count,
+                    const std::function<QByteArray (int)>& chunk)
+{
+    QDataStream out(device);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out.writeRawData(magic.constData(), magic.size());
+    out << version << tree;
+    // Counted here as sequential devices don't report their position
+    quint64 offset = magic.size() + sizeof(version) + sizeof(quint32) + tree.size();
+
+    QVector<ChunkIndex> index;
+    index.reserve(chunk_count);
+    for ( int i = 0; i < chunk_count; i++ )
+    {
+        QByteArray data = chunk(i);
+        ChunkIndex entry;
+        entry.offset = offset;
+        entry.size = data.size();
+        index.push_back(entry);
+        out.writeRawData(data.constData(), data.size());
+        offset += data.size();
+    }
+
+    out << quint32(index.size());
+    for ( const auto& entry : index )
+        out << entry.offset << entry.size;
+    out << offset;
+    out.writeRawData(index_magic.constData(), index_magic.size());
+
+    return out.status() == QDataStream::Ok;
+}
+
+/**
+ * \brief Read-only mapping of a file, shared by the images loading from it
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const QString& file_name)
+        : file(file_name)
+    {
+        if ( file.open(QFile::ReadOnly) && file.size() > 0 )
+        {
+            data = file.map(0, file.size());
+            if ( data )
+                size = file.size();
+        }
+    }
+
+    ~MappedFile()
+    {
+        if ( data )
+            file.unmap(data);
+    }
+
+    QFile file;
+    uchar* data = nullptr;
+    qint64 size = 0;
+};
+
+/**
+ * \brief Decodes an image chunk from a mapped file on demand
+ *
+ * Nothing is cached, images sharing the chunk decode it when they load
+ * so chunks of images that are never shown don't take memory.
+ */
+class ChunkSource : public document::ImageSource
+{
+public:
+    ChunkSource(const QSharedPointer<MappedFile>& file, const ChunkIndex& chunk,
+                const QSize& max_size)
+        : file(file), chunk(chunk), max_size(max_size)
+    {}
+
+    QImage load() const override
+    {
+        return decodeChunk(file->data + chunk.offset, chunk.size, max_size);
+    }
+
+    QByteArray encoded() const override
+    {
+        return QByteArray(reinterpret_cast<const char*>(file->data + chunk.offset), chunk.size);
+    }
+
+private:
+    QSharedPointer<MappedFile> file;
+    ChunkIndex chunk;
+    QSize max_size;
+};
+
+} // namespace binary
+
+SaverBinary::SaverBinary(binary::Compression compression)
+    : compression(compression), stream(&tree, QIODevice::WriteOnly)
+{
+    stream.setVersion(QDataStream::Qt_5_0);
+}
+
+bool SaverBinary::enter(document::Document& document)
+{
+    stream << quint8(binary::Tag::Document);
+    writeId(document);
+    stream << document.imageSize() << document.metadata();
+    return true;
+}
+
+void SaverBinary::leave(document::Document& document)
+{
+    stream << quint8(binary::Tag::EndDocument);
+}
+
+bool SaverBinary::enter(document::Layer& layer)
+{
+    stream << quint8(binary::Tag::Layer);
+    writeId(layer);
+    stream << layer.name() << double(layer.opacity()) << layer.visible()
+           << layer.locked() << qint32(layer.blendMode())
+           << layer.backgroundColor() << layer.metadata();
+    return true;
+}
+
+void SaverBinary::leave(document::Layer& layer)
+{
+    stream << quint8(binary::Tag::EndLayer);
+}
+
+void SaverBinary::visit(document::Image& image)
+{
+    stream << quint8(binary::Tag::Image);
+    writeId(image);
+    stream << (image.frame() ? image.frame()->objectName() : QString())
+           << image.metadata() << addChunk(image);
+}
+
+bool SaverBinary::enter(document::Animation& animation)
+{
+    stream << quint8(binary::Tag::Animation);
+    writeId(animation);
+    stream << animation.name() << qint32(animation.framesPerSecond())
+           << animation.metadata();
+    return true;
+}
+
+void SaverBinary::leave(document::Animation& animation)
+{
+    stream << quint8(binary::Tag::EndAnimation);
+}
+
+void SaverBinary::visit(document::Frame& frame)
+{
+    stream << quint8(binary::Tag::Frame);
+    writeId(frame);
+    stream << frame.metadata();
+}
+
+quint32 SaverBinary::addChunk(document::Image& image)
+{
+    int index = shared_images.add(image.image());
+    if ( index == chunks.size() )
+        chunks.push_back(QtConcurrent::run(binary::encodeChunk, image.image(), compression));
+    return index;
+}
+
+void SaverBinary::writeId(const document::DocumentElement& element)
+{
+    stream << element.objectName();
+}
+
+bool SaverBinary::write(QIODevice* device)
+{
+    bool ok = binary::writeContainer(device, tree, chunks.size(), [this](int i) {
+        return chunks[i].result();
+    });
+    chunks.clear();
+    return ok;
+}
+
+const QByteArray& SaverBinary::treeData() const
+{
+    return tree;
+}
+
+LoaderBinary::LoaderBinary(QIODevice* device)
+    : device(device), file_name(misc::fileName(device, tr("stream")))
+{
+}
+
+LoaderBinary::~LoaderBinary()
+{
+    delete builder.currentDocument();
+}
+
+document::Document* LoaderBinary::document()
+{
+    if ( !document_ )
+    {
+        map();
+        quint64 header_size = binary::magic.size() + sizeof(binary::version);
+        if ( quint64(size) < header_size ||
+             std::memcmp(data, binary::magic.constData(), binary::magic.size()) != 0 )
+            error(tr("Not a binary Cayman file"));
+        readIndex();
+        readTree();
+    }
+    return document_;
+}
+
+void LoaderBinary::map()
+{
+    auto file = qobject_cast<QFileDevice*>(device);
+    if ( file && !file->fileName().isEmpty() )
+    {
+        // Separate handle so images can keep loading after device is closed
+        QSharedPointer<binary::MappedFile> mapped_file(
+            new binary::MappedFile(file->fileName()));
+        if ( mapped_file->data )
+        {
+            mapping = mapped_file;
+            data = mapping->data;
+            size = mapping->size;
+            return;
+        }
+    }
+
+    buffer = device->readAll();
+    data = reinterpret_cast<const uchar*>(buffer.constData());
+    size = buffer.size();
+}
+
+void LoaderBinary::readIndex()
+{
+    const int trailer_size = sizeof(quint64) + binary::index_magic.size();
+    if ( size < trailer_size )
+        error(tr("Missing chunk index"));
+
+    const uchar* trailer = data + size - trailer_size;
+    if ( std::memcmp(trailer + sizeof(quint64), binary::index_magic.constData(),
+                     binary::index_magic.size()) != 0 )
+        error(tr("Missing chunk index"));
+
+    QByteArray trailer_data = QByteArray::fromRawData(
+        reinterpret_cast<const char*>(trailer), sizeof(quint64));
+    QDataStream trailer_stream(trailer_data);
+    quint64 index_offset;
+    trailer_stream >> index_offset;
+    if ( index_offset > quint64(size - trailer_size) )
+        error(tr("Invalid chunk index"));
+
+    QByteArray index_data = QByteArray::fromRawData(
+        reinterpret_cast<const char*>(data + index_offset),
+        size - trailer_size - index_offset);
+    QDataStream in(index_data);
+    quint32 count;
+    in >> count;
+    if ( in.status() != QDataStream::Ok ||
+         quint64(count) * 2 * sizeof(quint64) > quint64(index_data.size()) )
+        error(tr("Invalid chunk index"));
+
+    index.resize(count);
+    for ( auto& entry : index )
+    {
+        in >> entry.offset >> entry.size;
+        if ( entry.offset > index_offset || entry.size > index_offset - entry.offset )
+            error(tr("Invalid chunk index"));
+    }
+}
+
+void LoaderBinary::readTree()
+{
+    QByteArray raw = QByteArray::fromRawData(reinterpret_cast<const char*>(data), size);
+    QDataStream in(raw);
+    in.setVersion(QDataStream::Qt_5_0);
+    in.skipRawData(binary::magic.size());
+    quint32 file_version;
+    QByteArray tree;
+    in >> file_version >> tree;
+    if ( file_version > binary::version )
+        error(tr("Unsupported version %1").arg(file_version));
+    if ( in.status() != QDataStream::Ok )
+        error(tr("Corrupted document tree"));
+
+    QDataStream tree_stream(tree);
+    tree_stream.setVersion(QDataStream::Qt_5_0);
+    while ( !tree_stream.atEnd() )
+    {
+        quint8 tag;
+        tree_stream >> tag;
+
+        if ( binary::Tag(tag) != binary::Tag::Document && !builder.currentDocument() )
+            error(tr("Corrupted document tree"));
+
+        switch ( binary::Tag(tag) )
+        {
+            case binary::Tag::Document:
+            {
+                if ( !builder.beginDocument() )
+                    error(tr("Corrupted document tree"));
+                QString element_id;
+                QSize image_size;
+                document::Metadata metadata;
+                tree_stream >> element_id >> image_size >> metadata;
+                id(element_id);
+                builder.currentDocument()->setImageSize(image_size);
+                builder.currentElement()->metadata() = metadata;
+                break;
+            }
+            case binary::Tag::Layer:
+            {
+                document::Layer* layer = builder.beginLayer();
+                QString element_id, name;
+                double opacity;
+                bool visible, locked;
+                qint32 blend;
+                QColor background;
+                document::Metadata metadata;
+                tree_stream >> element_id >> name >> opacity >> visible
+                            >> locked >> blend >> background >> metadata;
+                id(element_id);
+                layer->setName(name);
+                layer->setOpacity(opacity);
+                layer->setVisible(visible);
+                layer->setLocked(locked);
+                layer->setBlendMode(QPainter::CompositionMode(blend));
+                layer->setBackgroundColor(background);
+                layer->metadata() = metadata;
+                break;
+            }
+            case binary::Tag::EndLayer:
+                builder.endLayer();
+                break;
+            case binary::Tag::Image:
+            {
+                if ( !builder.currentLayer() )
+                    error(tr("Corrupted document tree"));
+                if ( mapping )
+                    builder.beginImage(QImage());
+                else
+                    builder.beginImage();
+                QString element_id, frame;
+                document::Metadata metadata;
+                quint32 chunk;
+                tree_stream >> element_id >> frame >> metadata >> chunk;
+                id(element_id);
+                builder.setImageFrame(frame);
+                builder.currentElement()->metadata() = metadata;
+                if ( chunk >= quint32(index.size()) )
+                    error(tr("Missing image data"));
+                images.push_back(qMakePair(builder.currentImage(), chunk));
+                builder.endImage();
+                break;
+            }
+            case binary::Tag::Animation:
+            {
+                document::Animation* animation = builder.beginAnimation();
+                QString element_id, name;
+                qint32 fps;
+                document::Metadata metadata;
+                tree_stream >> element_id >> name >> fps >> metadata;
+                id(element_id);
+                animation->setName(name);
+                animation->setFramesPerSecond(qMax(1, fps));
+                animation->metadata() = metadata;
+                break;
+            }
+            case binary::Tag::EndAnimation:
+                builder.endAnimation();
+                break;
+            case binary::Tag::Frame:
+            {
+                if ( !builder.currentAnimation() )
+                    error(tr("Corrupted document tree"));
+                QString element_id;
+                document::Metadata metadata;
+                tree_stream >> element_id >> metadata;
+                builder.beginFrame(element_id);
+                id(element_id);
+                builder.currentElement()->metadata() = metadata;
+                builder.endFrame();
+                break;
+            }
+            case binary::Tag::EndDocument:
+                finishImages();
+                document_ = builder.endDocument();
+                return;
+            default:
+                error(tr("Corrupted document tree"));
+        }
+
+        if ( tree_stream.status() != QDataStream::Ok )
+            error(tr("Corrupted document tree"));
+    }
+
+    error(tr("Truncated document tree"));
+}
+
+void LoaderBinary::finishImages()
+{
+    QSize max_size = builder.currentDocument()->imageSize();
+
+    // Images referencing the same chunk end up sharing the same pixels
+    if ( !mapping )
+    {
+        QHash<quint32, QFuture<QImage>> decoded;
+        for ( const auto& image : images )
+            if ( !decoded.contains(image.second) )
+                decoded[image.second] = QtConcurrent::run(binary::decodeChunk,
+                    data + index[image.second].offset, index[image.second].size, max_size);
+
+        bool ok = true;
+        for ( const auto& image : images )
+        {
+            QImage pixels = decoded[image.second].result();
+            ok = ok && !pixels.isNull();
+            image.first->image() = pixels;
+        }
+        images.clear();
+
+        if ( !ok )
+            error(tr("Corrupted image data"));
+        return;
+    }
+
+    QHash<quint32, QSharedPointer<binary::ChunkSource>> sources;
+    for ( const auto& image : images )
+    {
+        auto& source = sources[image.second];
+        if ( !source )
+            source.reset(new binary::ChunkSource(mapping, index[image.second], max_size));
+    }
+
+    for ( const auto& lazy : images )
+    {
+        document::Image* image = lazy.first;
+        image->setSource(sources[lazy.second]);
+
+        bool visible = true;
+        for ( auto layer = image->layer(); layer && visible; layer = layer->parentLayer() )
+            visible = layer->visible();
+
+        // Hidden layers are left to be loaded when needed
+        if ( visible )
+            image->prefetch();
+    }
+    images.clear();
+}
+
+void LoaderBinary::id(const QString& id)
+{
+    if ( !id.isEmpty() )
+        builder.currentElement()->setObjectName(id);
+}
+
+bool FormatBinaryMela::onSave(document::Document* input, QIODevice* device)
+{
+    QString compression = setting<QString>("compression", input, "zlib");
+    SaverBinary saver(compression == "none" ?
+        binary::Compression::None : binary::Compression::Zlib);
+    input->apply(saver);
+    if ( !saver.write(device) )
+    {
+        setError(tr("Could not write %1").arg(fileName(device)));
+        return false;
+    }
+    return true;
+}
+
+document::Document* FormatBinaryMela::onOpen(QIODevice* device)
+{
+    try
+    {
+        return LoaderBinary(device).document();
+    }
+    catch ( const LoaderBinary::BinaryError& exc )
+    {
+        setError(QString::fromStdString(exc.what()));
+        return nullptr;
+    }
+}
+
+} // namespace io
@@ -0,0 +1,230 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_IO_BINARY_HPP
+#define PIXEL_CAYMAN_IO_BINARY_HPP
+
+#include <functional>
+#include <QDataStream>
+#include <QFuture>
+
+#include "formats.hpp"
+#include "document/builder.hpp"
+#include "misc/shared_images.hpp"
+
+namespace io {
+
+/**
+ * \brief Layout of the binary .mela container
+ *
+ * \code
+ *  magic "CAYMANB\0", version
+ *  tree size, tree           (element tags, see Tag)
+ *  chunk 0 ... chunk N-1     (one per distinct image, see Compression)
+ *  chunk count, [offset, size] x N
+ *  index offset, magic "CAYMANBI"
+ * \endcode
+ *
+ * All numbers are big endian as written by QDataStream
+ */
+namespace binary {
+
+constexpr quint32 version = 1;
+extern const QByteArray magic;
+extern const QByteArray index_magic;
+
+/**
+ * \brief Marks the elements in the document tree
+ */
+enum class Tag : quint8
+{
+    Document     = 'D',
+    EndDocument  = 'd',
+    Layer        = 'L',
+    EndLayer     = 'l',
+    Image        = 'I',
+    Animation    = 'A',
+    EndAnimation = 'a',
+    Frame        = 'F',
+};
+
+/**
+ * \brief How the pixel data of an image chunk is stored
+ */
+enum class Compression : quint8
+{
+    None = 0,
+    Zlib = 1,
+};
+
+/**
+ * \brief Position of a chunk within the file
+ */
+struct ChunkIndex
+{
+    quint64 offset = 0;
+    quint64 size = 0;
+};
+
+class MappedFile;
+
+/**
+ * \brief Serializes the pixels of \p image as a chunk
+ * \note Thread safe
+ */
+QByteArray encodeChunk(QImage image, Compression compression);
+
+/**
+ * \brief Restores an image from a chunk created by encodeChunk()
+ * \param max_size Size of the document, larger images are rejected
+ * \note Thread safe, \p data must stay valid until it returns
+ * \return A null image if the chunk is not valid
+ */
+QImage decodeChunk(const uchar* data, quint64 size, const QSize& max_size);
+
+/**
+ * \brief Writes a whole file from the serialized tree and its chunks
+ * \param chunk Called in order to retrieve the contents of each chunk
+ */
+bool writeContainer(QIODevice* device, const QByteArray& tree, int chunk_count,
+                    const std::function<QByteArray (int)>& chunk);
+
+} // namespace binary
+
+/**
+ * \brief Visitor that writes the document tree and compresses image chunks
+ *
+ * Chunks are compressed on the global thread pool while the tree is written
+ */
+class SaverBinary : public document::Visitor
+{
+public:
+    explicit SaverBinary(binary::Compression compression);
+
+    bool enter(document::Document& document) override;
+    void leave(document::Document& document) override;
+    bool enter(document::Layer& layer) override;
+    void leave(document::Layer& layer) override;
+    void visit(document::Image& image) override;
+    bool enter(document::Animation& animation) override;
+    void leave(document::Animation& animation) override;
+    void visit(document::Frame& frame) override;
+
+    /**
+     * \brief Writes the whole file, to be called after the document has been visited
+     */
+    bool write(QIODevice* device);
+
+    /**
+     * \brief Serialized document tree
+     */
+    const QByteArray& treeData() const;
+
+protected:
+    /**
+     * \brief Called for every image, returns the index of its chunk
+     *
+     * The default implementation starts compressing the image in the thread pool,
+     * identical images share the same chunk
+     */
+    virtual quint32 addChunk(document::Image& image);
+
+private:
+    void writeId(const document::DocumentElement& element);
+
+    binary::Compression compression;
+    QByteArray tree;
+    QDataStream stream;
+    QList<QFuture<QByteArray>> chunks;
+    misc::SharedImages shared_images;
+};
+
+class LoaderBinary
+{
+    Q_DECLARE_TR_FUNCTIONS(FormatBinaryMela)
+    Q_DISABLE_COPY(LoaderBinary)
+public:
+    class BinaryError : public std::runtime_error
+    {
+    public:
+        BinaryError(const QString& message)
+            : runtime_error(message.toStdString()) {}
+    };
+
+    explicit LoaderBinary(QIODevice* device);
+    ~LoaderBinary();
+
+    document::Document* document();
+
+private:
+    void error(const QString& message)
+    {
+        throw BinaryError(tr("Binary file error %1: %2")
+            .arg(file_name).arg(message));
+    }
+
+    /**
+     * \brief Makes the file contents available in \c data
+     *
+     * Files are memory mapped when possible, in which case images are
+     * only decoded when first needed (visible layers are prefetched).
+     */
+    void map();
+    void readIndex();
+    void readTree();
+    void finishImages();
+    void id(const QString& id);
+
+    QIODevice* device;
+    QString file_name;
+    QByteArray buffer;
+    const uchar* data = nullptr;
+    qint64 size = 0;
+    QSharedPointer<binary::MappedFile> mapping;
+
+    QVector<binary::ChunkIndex> index;
+    QList<QPair<document::Image*, quint32>> images; ///< Image and chunk index
+
+    document::Builder builder;
+    document::Document* document_ = nullptr;
+};
+
+/**
+ * \brief Reads/writes binary .mela files
+ *
+ * Stores raw or zlib-compressed pixel data instead of base64 image files,
+ * it's faster to read and write and doesn't require parsing XML.
+ */
+class FormatBinaryMela : public AbstractFormat
+{
+    Q_DECLARE_TR_FUNCTIONS(FormatBinaryMela)
+public:
+    QString id() const override { return "melab"; }
+    QString name() const override { return tr("Cayman Binary Files"); }
+    bool canSave() const override { return true; }
+    bool canOpen() const override { return true; }
+
+protected:
+    bool onSave(document::Document* input, QIODevice* device) override;
+    document::Document* onOpen(QIODevice* device) override;
+};
+
+} // namespace io
+#endif // PIXEL_CAYMAN_IO_BINARY_HPP
@@ -39,6 +39,8 @@ public:
     QStringList extensions(Action action) const override;
     bool canSave() const override { return true; }
     bool canOpen() const override { return true; }
+    /// Some image writers need to seek in the output
+    bool canSaveSequential() const override { return false; }
 
 protected:
 
@@ -22,6 +22,7 @@
 
 #include "formats.hpp"
 #include <QFileInfo>
+#include <QSaveFile>
 
 namespace io {
 
@@ -30,12 +31,56 @@ bool AbstractFormat::save(document::Document* document, const QString& filename)
     if ( filename.isEmpty() )
         return false;
 
-    QFile file(filename);
+    // Lazy images might be reading from the file being overwritten
+    document::visitor::LoadImages loader;
+    document->apply(loader);
 
+    QSaveFile file(filename);
     if ( !file.open(QFile::WriteOnly) )
+    {
+        setError(tr("Could not open %1: %2").arg(filename).arg(file.errorString()));
+        return false;
+    }
+
+    bool ok;
+    QString write_error;
+    if ( canSaveSequential() && cayman::settings::get("file/write_behind", true) )
+    {
+        misc::WriteBehindDevice buffer(&file);
+        ok = save(document, &buffer);
+        buffer.close();
+        if ( buffer.failed() )
+            write_error = buffer.errorString();
+    }
+    else
+    {
+        ok = save(document, &file);
+        if ( file.error() != QFile::NoError )
+            write_error = file.errorString();
+    }
+
+    if ( !write_error.isEmpty() )
+    {
+        file.cancelWriting();
+        setError(tr("Error writing %1: %2").arg(filename).arg(write_error));
+        return false;
+    }
+
+    if ( !ok )
+    {
+        file.cancelWriting();
+        if ( !hasError() )
+            setError(tr("Could not save %1").arg(filename));
         return false;
+    }
+
+    if ( !file.commit() )
+    {
+        setError(tr("Error writing %1: %2").arg(filename).arg(file.errorString()));
+        return false;
+    }
 
-    return save(document, &file);
+    return true;
 }
 
 bool AbstractFormat::save(document::Document* document)
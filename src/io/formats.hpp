@@ -23,6 +23,7 @@
 
 #include <QFile>
 #include <QCoreApplication>
+#include <QThreadStorage>
 #include "cayman/settings.hpp"
 #include "document/visitor.hpp"
 #include "misc/misc.hpp"
@@ -81,6 +82,14 @@ public:
 
     virtual bool canSave() const { return false; }
 
+    /**
+     * \brief Whether onSave() can write to a sequential device
+     *
+     * When saving to a file, such formats are written through a buffer
+     * flushed from a background thread.
+     */
+    virtual bool canSaveSequential() const { return true; }
+
     /**
      * \brief Save the document contents to the output device
      * \return \b true on success
@@ -93,6 +102,9 @@ public:
 
     /**
      * \brief Save the document to a file with the given name
+     *
+     * The data is written to a temporary file which replaces \p filename
+     * only if the whole document has been saved successfully.
      * \return \b true on success
      */
     bool save(document::Document* document, const QString& filename);
@@ -144,7 +156,7 @@ public:
      * \brief Get a single option from the document or the global settings
      */
     template<class T>
-        T setting(const QString& key, document::Document* document = nullptr, T&& default_value = T()) const
+        T setting(const QString& key, const document::Document* document = nullptr, T&& default_value = T()) const
         {
             QVariant variant;
             if ( document )
@@ -159,15 +171,18 @@ public:
      */
     bool hasError() const
     {
-        return  !error_string.isEmpty();
+        return !errorString().isEmpty();
     }
 
     /**
      * \brief The current error string
+     *
+     * Errors are tracked per thread so the same format can be used to
+     * save or open multiple files concurrently.
      */
     QString errorString() const
     {
-        return error_string;
+        return error_string.hasLocalData() ? error_string.localData() : QString();
     }
 
 protected:
@@ -184,7 +199,7 @@ protected:
      */
     void setError(const QString& message)
     {
-        error_string = message;
+        error_string.setLocalData(message);
     }
 
     /**
@@ -192,7 +207,7 @@ protected:
      */
     void clearError()
     {
-        error_string.clear();
+        error_string.setLocalData(QString());
     }
 
     /**
@@ -208,7 +223,7 @@ protected:
     virtual document::Document* onOpen(QIODevice* device) { return nullptr; }
 
 private:
-    QString error_string;
+    QThreadStorage<QString> error_string;
 };
 
 /**
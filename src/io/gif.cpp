@@ -0,0 +1,357 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "gif.hpp"
+
+#include <numeric>
+#include <vector>
+#include <QtConcurrent>
+
+#include "animated.hpp"
+#include "misc/color_histogram.hpp"
+#include "misc/color_reducer.hpp"
+
+namespace io {
+
+namespace {
+
+/**
+ * \brief Image block stored in the file
+ */
+struct Block
+{
+    QRect rect;
+    int delay;          ///< Centiseconds
+    bool dispose;       ///< Whether rect is cleared after being displayed
+    QByteArray data;    ///< Color indices
+};
+
+/**
+ * \brief Makes the alpha channel binary, transparent pixels become 0
+ */
+void normalizeAlpha(QImage& image)
+{
+    uchar* bits = image.bits();
+    for ( int y = 0; y < image.height(); y++ )
+    {
+        QRgb* line = reinterpret_cast<QRgb*>(bits + y * image.bytesPerLine());
+        for ( int x = 0; x < image.width(); x++ )
+            line[x] = qAlpha(line[x]) < 128 ? 0 : line[x] | 0xff000000;
+    }
+}
+
+/**
+ * \brief Bounding rect of the pixels which are transparent in \p next
+ *        but not in \p image
+ */
+QRect vanishingRect(const QImage& image, const QImage& next, int transparent)
+{
+    QRect rect;
+    for ( int y = 0; y < image.height(); y++ )
+    {
+        const uchar* line = image.constScanLine(y);
+        const uchar* next_line = next.constScanLine(y);
+        for ( int x = 0; x < image.width(); x++ )
+            if ( next_line[x] == transparent && line[x] != transparent )
+                rect |= QRect(x, y, 1, 1);
+    }
+    return rect;
+}
+
+/**
+ * \brief Compresses color indices with the variable width LZW used by GIF
+ */
+QByteArray lzwEncode(const QByteArray& indices, int min_code_size)
+{
+    const int hash_size = 5003;
+    const int max_code = 4095;
+    const int clear_code = 1 << min_code_size;
+    const int end_code = clear_code + 1;
+
+    // Maps (prefix code, pixel) to the code of the extended string
+    std::vector<int> keys(hash_size, -1);
+    std::vector<quint16> codes(hash_size);
+    int next_code = end_code + 1;
+    int code_size = min_code_size + 1;
+
+    QByteArray output;
+    quint32 buffer = 0;
+    int buffer_bits = 0;
+    auto put = [&](int code) {
+        buffer |= quint32(code) << buffer_bits;
+        buffer_bits += code_size;
+        while ( buffer_bits >= 8 )
+        {
+            output.append(char(buffer & 0xff));
+            buffer >>= 8;
+            buffer_bits -= 8;
+        }
+    };
+
+    put(clear_code);
+    const uchar* data = reinterpret_cast<const uchar*>(indices.constData());
+    int prefix = indices.isEmpty() ? -1 : data[0];
+    for ( int i = 1; i < indices.size(); i++ )
+    {
+        int pixel = data[i];
+        int key = (pixel << 12) | prefix;
+        int slot = ((pixel << 4) ^ prefix) % hash_size;
+        int step = slot == 0 ? 1 : hash_size - slot;
+        while ( keys[slot] != -1 && keys[slot] != key )
+        {
+            slot -= step;
+            if ( slot < 0 )
+                slot += hash_size;
+        }
+
+        if ( keys[slot] == key )
+        {
+            prefix = codes[slot];
+            continue;
+        }
+
+        put(prefix);
+        keys[slot] = key;
+        codes[slot] = next_code;
+        if ( next_code >= (1 << code_size) )
+            code_size++;
+
+        if ( next_code == max_code )
+        {
+            put(clear_code);
+            std::fill(keys.begin(), keys.end(), -1);
+            next_code = end_code + 1;
+            code_size = min_code_size + 1;
+        }
+        else
+        {
+            next_code++;
+        }
+        prefix = pixel;
+    }
+
+    if ( prefix != -1 )
+        put(prefix);
+    put(end_code);
+    if ( buffer_bits > 0 )
+        output.append(char(buffer & 0xff));
+    return output;
+}
+
+void writeUint16(QByteArray& data, int value)
+{
+    data.append(char(value & 0xff));
+    data.append(char((value >> 8) & 0xff));
+}
+
+} // namespace
+
+bool FormatGif::onSave(document::Document* input, QIODevice* device)
+{
+    QSize size = input->imageSize();
+    if ( size.width() > 0xffff || size.height() > 0xffff )
+    {
+        setError(tr("The image is too large to be saved as GIF"));
+        return false;
+    }
+
+    QVector<AnimatedFrame> frames = renderAnimation(input,
+        setting<QString>("animation", input), setting("full_alpha", input, false));
+    bool loop = setting("loop", input, true);
+
+    QtConcurrent::blockingMap(frames, [](AnimatedFrame& frame) {
+        normalizeAlpha(frame.image);
+    });
+
+    int count = frames.size();
+    QVector<int> frame_indices(count);
+    std::iota(frame_indices.begin(), frame_indices.end(), 0);
+
+    // Palette, reusing the document one avoids requantizing indexed art
+    QVector<QRgb> palette;
+    misc::Quantizer::Dither dither = misc::Quantizer::Dither::None;
+    if ( input->indexedColors() && !input->colorTable().isEmpty() &&
+         input->colorTable().size() <= 256 )
+    {
+        palette = input->colorTable();
+        bool transparent = false;
+        for ( QRgb color : palette )
+            transparent = transparent || qAlpha(color) < 128;
+        if ( !transparent && palette.size() < 256 )
+            palette.push_back(qRgba(0, 0, 0, 0));
+    }
+    else
+    {
+        QVector<misc::ColorHistogram> histograms(count);
+        QtConcurrent::blockingMap(frame_indices, [&frames, &histograms](int i) {
+            histograms[i].add(frames[i].image, 0, frames[i].image.height());
+        });
+        misc::ColorHistogram histogram;
+        for ( const auto& frame_histogram : histograms )
+            histogram.merge(frame_histogram);
+
+        palette = misc::ColorReducer(misc::ColorReducer::Algorithm::MedianCut, 256)
+            .reduce(histogram);
+        // Ordered dithering doesn't propagate changes outside the edited area
+        if ( histogram.size() > palette.size() )
+            dither = misc::Quantizer::Dither::Ordered;
+    }
+    if ( palette.isEmpty() )
+        palette.push_back(qRgba(0, 0, 0, 0));
+
+    misc::Quantizer quantizer(palette);
+    int transparent = -1;
+    for ( QRgb color : palette )
+        if ( qAlpha(color) < 128 )
+            transparent = quantizer.index(color);
+
+    QVector<QImage> indexed;
+    indexed.reserve(frames.size());
+    for ( const auto& frame : frames )
+        indexed.push_back(quantizer.quantize(frame.image, dither));
+
+    // Areas to update and to clear, computed on the indices
+    QVector<QRect> changed(count);
+    QVector<QRect> vanishing(count);
+    QtConcurrent::blockingMap(frame_indices, [&](int i) {
+        changed[i] = i == 0 ? input->imageRect() : differenceRect(indexed[i-1], indexed[i]);
+        // When looping the first frame is drawn over the last one
+        int next = i + 1 < count ? i + 1 : (loop ? 0 : i);
+        if ( transparent != -1 && next != i )
+            vanishing[i] = vanishingRect(indexed[i], indexed[next], transparent);
+    });
+
+    QVector<Block> blocks;
+    QVector<int> block_frames;
+    QVector<QRect> cleared;     ///< Area disposed by the previous block
+    QRect disposed;
+    for ( int i = 0; i < count; i++ )
+    {
+        int delay = qMin((frames[i].duration + 5) / 10, 0xffff);
+        QRect rect = changed[i] | disposed;
+        if ( rect.isEmpty() && vanishing[i].isEmpty() && !blocks.isEmpty() )
+        {
+            Block& previous = blocks.back();
+            previous.delay = qMin(previous.delay + delay, 0xffff);
+            continue;
+        }
+
+        Block block;
+        block.dispose = !vanishing[i].isEmpty();
+        if ( block.dispose )
+            rect |= vanishing[i];
+        block.rect = rect;
+        block.delay = delay;
+        blocks.push_back(block);
+        block_frames.push_back(i);
+        cleared.push_back(disposed);
+        disposed = block.dispose ? rect : QRect();
+    }
+
+    QVector<int> block_indices(blocks.size());
+    std::iota(block_indices.begin(), block_indices.end(), 0);
+    int table_bits = 1;
+    while ( (1 << table_bits) < palette.size() )
+        table_bits++;
+    int min_code_size = qMax(2, table_bits);
+    QtConcurrent::blockingMap(block_indices, [&](int b) {
+        Block& block = blocks[b];
+        int frame = block_frames[b];
+        const QImage& image = indexed[frame];
+        const QImage* previous = frame > 0 && transparent != -1 ? &indexed[frame-1] : nullptr;
+
+        QByteArray data(block.rect.width() * block.rect.height(), 0);
+        char* out = data.data();
+        for ( int y = block.rect.top(); y <= block.rect.bottom(); y++ )
+        {
+            const uchar* line = image.constScanLine(y);
+            const uchar* previous_line = previous ? previous->constScanLine(y) : nullptr;
+            for ( int x = block.rect.left(); x <= block.rect.right(); x++ )
+            {
+                // Unchanged pixels still on screen can be skipped
+                if ( previous_line && line[x] == previous_line[x] &&
+                     !cleared[b].contains(x, y) )
+                    *out++ = char(transparent);
+                else
+                    *out++ = char(line[x]);
+            }
+        }
+        block.data = lzwEncode(data, min_code_size);
+    });
+
+    QByteArray header("GIF89a");
+    writeUint16(header, size.width());
+    writeUint16(header, size.height());
+    // Global color table, 8 bits per channel
+    header.append(char(0xf0 | (table_bits - 1)));
+    header.append(char(transparent == -1 ? 0 : transparent));
+    header.append(char(0));
+    for ( int i = 0; i < (1 << table_bits); i++ )
+    {
+        QRgb color = i < palette.size() ? palette[i] : 0;
+        header.append(char(qRed(color)));
+        header.append(char(qGreen(color)));
+        header.append(char(qBlue(color)));
+    }
+
+    if ( blocks.size() > 1 && loop )
+    {
+        header.append("\x21\xff\x0bNETSCAPE2.0\x03\x01", 16);
+        writeUint16(header, 0);
+        header.append(char(0));
+    }
+    device->write(header);
+
+    for ( const Block& block : blocks )
+    {
+        QByteArray chunk;
+        // Graphic control extension
+        chunk.append("\x21\xf9\x04", 3);
+        chunk.append(char(((block.dispose ? 2 : 1) << 2) | (transparent != -1 ? 1 : 0)));
+        writeUint16(chunk, block.delay);
+        chunk.append(char(transparent == -1 ? 0 : transparent));
+        chunk.append(char(0));
+
+        // Image descriptor
+        chunk.append(char(0x2c));
+        writeUint16(chunk, block.rect.x());
+        writeUint16(chunk, block.rect.y());
+        writeUint16(chunk, block.rect.width());
+        writeUint16(chunk, block.rect.height());
+        chunk.append(char(0));
+
+        chunk.append(char(min_code_size));
+        for ( int i = 0; i < block.data.size(); i += 255 )
+        {
+            int length = qMin(255, block.data.size() - i);
+            chunk.append(char(length));
+            chunk.append(block.data.constData() + i, length);
+        }
+        chunk.append(char(0));
+        device->write(chunk);
+    }
+
+    device->write("\x3b", 1);
+    return true;
+}
+
+} // namespace io
@@ -0,0 +1,58 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_IO_GIF_HPP
+#define PIXEL_CAYMAN_IO_GIF_HPP
+
+#include "formats.hpp"
+
+namespace io {
+
+/**
+ * \brief Exports an animation as an animated GIF
+ *
+ * Each frame only stores the area which changed since the previous one,
+ * pixels which are unchanged within that area are stored as transparent.
+ * Pixels which become transparent are cleared by disposing the previous
+ * frame to the background.
+ *
+ * Documents with indexed colors use their color table, otherwise a palette
+ * is generated from the colors of all the frames.
+ *
+ * Settings:
+ *  - \c animation   Name of the animation, if empty the first one with frames
+ *  - \c loop        Whether the animation repeats (default \b true)
+ *  - \c full_alpha  Whether to ignore layer visibility and opacity
+ */
+class FormatGif : public AbstractFormat
+{
+    Q_DECLARE_TR_FUNCTIONS(FormatGif)
+public:
+    QString id() const override { return "gif"; }
+    QString name() const override { return tr("Animated GIF"); }
+    QStringList extensions(Action action) const override { return {"gif"}; }
+    bool canSave() const override { return true; }
+
+protected:
+    bool onSave(document::Document* input, QIODevice* device) override;
+};
+
+} // namespace io
+#endif // PIXEL_CAYMAN_IO_GIF_HPP
@@ -0,0 +1,298 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sprite_sheet.hpp"
+
+#include <cstring>
+#include <numeric>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QXmlStreamWriter>
+#include <QtConcurrent>
+
+#include "animated.hpp"
+#include "misc/rect_packer.hpp"
+#include "misc/shared_images.hpp"
+
+namespace io {
+
+namespace {
+
+/**
+ * \brief Frame or layer exported as a sprite
+ */
+struct Sprite
+{
+    QString name;
+    document::DocumentElement* root;    ///< Element to render
+    document::Frame* frame;
+    int duration;                       ///< In milliseconds, 0 for layers
+    QImage image;
+    QRect trim;                         ///< Area of image stored in the atlas
+    int shared;                         ///< Index of the distinct sprite
+};
+
+/**
+ * \brief Bounding rect of the pixels which aren't fully transparent
+ */
+QRect opaqueRect(const QImage& image)
+{
+    int left = image.width();
+    int right = -1;
+    int top = -1;
+    int bottom = -1;
+
+    for ( int y = 0; y < image.height(); y++ )
+    {
+        const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        int first = 0;
+        while ( first < image.width() && qAlpha(line[first]) == 0 )
+            first++;
+        if ( first == image.width() )
+            continue;
+
+        int last = image.width() - 1;
+        while ( last > right && qAlpha(line[last]) == 0 )
+            last--;
+
+        left = qMin(left, first);
+        right = qMax(right, last);
+        if ( top == -1 )
+            top = y;
+        bottom = y;
+    }
+
+    if ( top == -1 )
+        return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+QJsonObject rectJson(const QRect& rect)
+{
+    return QJsonObject{
+        {"x", rect.x()}, {"y", rect.y()},
+        {"w", rect.width()}, {"h", rect.height()}
+    };
+}
+
+} // namespace
+
+bool FormatSpriteSheet::onSave(document::Document* input, QIODevice* device)
+{
+    QString descriptor_name = misc::fileName(device);
+    if ( descriptor_name.isEmpty() )
+    {
+        setError(tr("Sprite sheets can only be saved to files"));
+        return false;
+    }
+    QFileInfo descriptor_info(descriptor_name);
+    QString image_name = descriptor_info.completeBaseName() + ".png";
+    bool xml = descriptor_info.suffix().compare("xml", Qt::CaseInsensitive) == 0;
+
+    QString source = setting<QString>("source", input, "auto");
+    bool trim = setting("trim", input, true);
+    int padding = qMax(0, setting("padding", input, 1));
+    int max_width = qMax(1, setting("max_width", input, 4096));
+    bool full_alpha = setting("full_alpha", input, false);
+
+    QVector<Sprite> sprites;
+    QVector<QPair<QString, int>> tags; ///< Animation name and first frame
+    bool has_frames = false;
+    for ( auto animation : input->animations() )
+        has_frames = has_frames || animation->count();
+
+    if ( source == "frames" || (source != "layers" && has_frames) )
+    {
+        for ( auto animation : input->animations() )
+        {
+            QString name = animation->name().isEmpty() ? tr("Frame") : animation->name();
+            tags.push_back(qMakePair(name, sprites.size()));
+            int duration = 1000 / qMax(1, animation->framesPerSecond());
+            for ( int i = 0; i < animation->count(); i++ )
+                sprites.push_back({QString("%1 %2").arg(name).arg(i), input,
+                                   animation->frame(i), duration, QImage(), QRect(), 0});
+        }
+    }
+    else
+    {
+        for ( auto layer : input->layers() )
+            sprites.push_back({layer->name(), layer, nullptr, 0, QImage(), QRect(), 0});
+    }
+
+    if ( sprites.isEmpty() )
+    {
+        setError(tr("Nothing to export"));
+        return false;
+    }
+
+    QSize size = input->imageSize();
+    QtConcurrent::blockingMap(sprites, [size, full_alpha, trim](Sprite& sprite) {
+        sprite.image = renderFrame(sprite.root, sprite.frame, size, full_alpha);
+        sprite.trim = trim ? opaqueRect(sprite.image) : sprite.image.rect();
+        // Keep a transparent pixel so fully transparent sprites have a place
+        if ( sprite.trim.isEmpty() )
+            sprite.trim = QRect(0, 0, 1, 1);
+    });
+
+    // Identical sprites are stored only once
+    misc::SharedImages shared;
+    QVector<int> distinct;
+    for ( int i = 0; i < sprites.size(); i++ )
+    {
+        Sprite& sprite = sprites[i];
+        sprite.shared = shared.add(sprite.image.copy(sprite.trim));
+        if ( sprite.shared == distinct.size() )
+            distinct.push_back(i);
+    }
+
+    QVector<QSize> sizes;
+    for ( int index : distinct )
+        sizes.push_back(sprites[index].trim.size() + QSize(padding, padding));
+    QSize bin_size;
+    QVector<QRect> rects = misc::RectPacker::pack(sizes, max_width + padding, bin_size);
+    if ( rects.isEmpty() )
+    {
+        setError(tr("The sprites don't fit in a sheet %1 pixels wide").arg(max_width));
+        return false;
+    }
+
+    QImage atlas((bin_size - QSize(padding, padding)).expandedTo(QSize(1, 1)),
+                 QImage::Format_ARGB32);
+    atlas.fill(Qt::transparent);
+    uchar* atlas_bits = atlas.bits();
+    int atlas_stride = atlas.bytesPerLine();
+    QVector<int> blits(distinct.size());
+    std::iota(blits.begin(), blits.end(), 0);
+    QtConcurrent::blockingMap(blits, [&](int index) {
+        const Sprite& sprite = sprites[distinct[index]];
+        QPoint pos = rects[index].topLeft();
+        for ( int y = 0; y < sprite.trim.height(); y++ )
+            std::memcpy(
+                atlas_bits + (pos.y() + y) * atlas_stride + pos.x() * 4,
+                sprite.image.constScanLine(sprite.trim.top() + y) + sprite.trim.left() * 4,
+                sprite.trim.width() * 4
+            );
+    });
+
+    QSaveFile image_file(descriptor_info.dir().filePath(image_name));
+    QImageWriter writer(&image_file, "png");
+    if ( !image_file.open(QIODevice::WriteOnly) || !writer.write(atlas) || !image_file.commit() )
+    {
+        setError(tr("Could not save %1: %2").arg(image_file.fileName())
+            .arg(writer.error() != QImageWriter::UnknownError ?
+                 writer.errorString() : image_file.errorString()));
+        return false;
+    }
+
+    if ( xml )
+    {
+        QXmlStreamWriter descriptor(device);
+        descriptor.setAutoFormatting(true);
+        descriptor.writeStartDocument();
+        descriptor.writeStartElement("TextureAtlas");
+        descriptor.writeAttribute("imagePath", image_name);
+        descriptor.writeAttribute("width", QString::number(atlas.width()));
+        descriptor.writeAttribute("height", QString::number(atlas.height()));
+        for ( const Sprite& sprite : sprites )
+        {
+            QPoint pos = rects[sprite.shared].topLeft();
+            descriptor.writeEmptyElement("sprite");
+            descriptor.writeAttribute("n", sprite.name);
+            descriptor.writeAttribute("x", QString::number(pos.x()));
+            descriptor.writeAttribute("y", QString::number(pos.y()));
+            descriptor.writeAttribute("w", QString::number(sprite.trim.width()));
+            descriptor.writeAttribute("h", QString::number(sprite.trim.height()));
+            descriptor.writeAttribute("oX", QString::number(sprite.trim.x()));
+            descriptor.writeAttribute("oY", QString::number(sprite.trim.y()));
+            descriptor.writeAttribute("oW", QString::number(size.width()));
+            descriptor.writeAttribute("oH", QString::number(size.height()));
+            if ( sprite.duration )
+                descriptor.writeAttribute("duration", QString::number(sprite.duration));
+        }
+        descriptor.writeEndElement();
+        descriptor.writeEndDocument();
+        if ( descriptor.hasError() )
+        {
+            setError(tr("Could not write %1").arg(fileName(device)));
+            return false;
+        }
+        return true;
+    }
+
+    QJsonArray frames;
+    for ( const Sprite& sprite : sprites )
+    {
+        QJsonObject frame{
+            {"filename", sprite.name},
+            {"frame", rectJson(QRect(rects[sprite.shared].topLeft(), sprite.trim.size()))},
+            {"rotated", false},
+            {"trimmed", sprite.trim.size() != size},
+            {"spriteSourceSize", rectJson(sprite.trim)},
+            {"sourceSize", QJsonObject{{"w", size.width()}, {"h", size.height()}}},
+        };
+        if ( sprite.duration )
+            frame["duration"] = sprite.duration;
+        frames.push_back(frame);
+    }
+
+    QJsonArray frame_tags;
+    for ( int i = 0; i < tags.size(); i++ )
+    {
+        int end = i + 1 < tags.size() ? tags[i + 1].second : sprites.size();
+        if ( end > tags[i].second )
+            frame_tags.push_back(QJsonObject{
+                {"name", tags[i].first},
+                {"from", tags[i].second},
+                {"to", end - 1},
+                {"direction", "forward"},
+            });
+    }
+
+    QJsonObject meta{
+        {"app", QCoreApplication::applicationName()},
+        {"version", QCoreApplication::applicationVersion()},
+        {"image", image_name},
+        {"format", "RGBA8888"},
+        {"size", QJsonObject{{"w", atlas.width()}, {"h", atlas.height()}}},
+        {"scale", "1"},
+    };
+    if ( !frame_tags.isEmpty() )
+        meta["frameTags"] = frame_tags;
+
+    QByteArray json = QJsonDocument(QJsonObject{
+        {"frames", frames},
+        {"meta", meta},
+    }).toJson();
+    if ( device->write(json) != json.size() )
+    {
+        setError(tr("Could not write %1").arg(fileName(device)));
+        return false;
+    }
+    return true;
+}
+
+} // namespace io
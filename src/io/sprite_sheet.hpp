@@ -0,0 +1,55 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_IO_SPRITE_SHEET_HPP
+#define PIXEL_CAYMAN_IO_SPRITE_SHEET_HPP
+
+#include "formats.hpp"
+
+namespace io {
+
+/**
+ * \brief Exports animation frames or layers packed into a texture atlas
+ *
+ * The device receives the JSON or XML descriptor (depending on the file
+ * extension), the atlas is saved as a PNG next to it.
+ *
+ * Settings:
+ *  - \c source      "frames", "layers" or "auto" (frames if there are any)
+ *  - \c trim        Whether to remove transparent borders (default \b true)
+ *  - \c padding     Pixels between sprites (default 1)
+ *  - \c max_width   Maximum width of the atlas (default 4096)
+ *  - \c full_alpha  Whether to ignore layer visibility and opacity
+ */
+class FormatSpriteSheet : public AbstractFormat
+{
+    Q_DECLARE_TR_FUNCTIONS(FormatSpriteSheet)
+public:
+    QString id() const override { return "spritesheet"; }
+    QString name() const override { return tr("Sprite Sheet"); }
+    QStringList extensions(Action action) const override { return {"json", "xml"}; }
+    bool canSave() const override { return true; }
+
+protected:
+    bool onSave(document::Document* input, QIODevice* device) override;
+};
+
+} // namespace io
+#endif // PIXEL_CAYMAN_IO_SPRITE_SHEET_HPP
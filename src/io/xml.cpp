@@ -24,8 +24,10 @@
 #include <QMimeDatabase>
 #include <QImageWriter>
 #include <QImageReader>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include "misc/composition_mode.hpp"
+#include "misc/shared_images.hpp"
 #include "color_names.hpp"
 
 static QMimeType mimeType(const QString &name, const QString& fallback)
@@ -39,6 +41,75 @@ static QMimeType mimeType(const QString &name, const QString& fallback)
     return type;
 }
 
+/**
+ * \brief Encodes \p image as base64 text in the given file format
+ * \note Thread safe, it only works on copies of its arguments
+ */
+static QByteArray encodeImage(QImage image, QByteArray format)
+{
+    QByteArray image_data;
+    QBuffer buffer(&image_data);
+    QImageWriter image_writer(&buffer, format);
+    image_writer.write(image);
+    return image_data.toBase64();
+}
+
+/**
+ * \brief Decodes an image file contained in \p data
+ * \note Thread safe, it only works on copies of its arguments
+ */
+static QImage decodeImage(QByteArray data, QByteArray format)
+{
+    QImage image;
+    QBuffer buffer(&data);
+    QImageReader reader(&buffer, format);
+    reader.read(&image);
+    return image;
+}
+
+/**
+ * \brief Decodes base64 text received in chunks of arbitrary size
+ */
+class Base64Decoder
+{
+public:
+    explicit Base64Decoder(QByteArray& output) : output(output) {}
+
+    ~Base64Decoder()
+    {
+        finish();
+    }
+
+    void feed(const QStringRef& text)
+    {
+        const QChar* chars = text.unicode();
+        for ( int i = 0; i < text.size(); i++ )
+            if ( !chars[i].isSpace() )
+                pending.push_back(chars[i].toLatin1());
+
+        // Only whole groups of 4 characters can be decoded
+        int usable = pending.size() - pending.size() % 4;
+        if ( usable > 0 )
+        {
+            output += QByteArray::fromBase64(QByteArray::fromRawData(pending.constData(), usable));
+            pending.remove(0, usable);
+        }
+    }
+
+    void finish()
+    {
+        if ( !pending.isEmpty() )
+        {
+            output += QByteArray::fromBase64(pending);
+            pending.clear();
+        }
+    }
+
+private:
+    QByteArray& output;
+    QByteArray pending;
+};
+
 namespace io {
 
 SaverXml::SaverXml(QIODevice* output)
@@ -58,6 +129,23 @@ bool SaverXml::enter(document::Document& document)
     QString format = formats().format("mela")->setting<QString>("image_format", &document);
     image_format = mimeType(format, "image/png");
 
+    // Start encoding everything up front, visit() picks them up in order
+    document::visitor::CollectImages collector;
+    document.apply(collector);
+    QByteArray suffix = image_format.preferredSuffix().toLatin1();
+    misc::SharedImages shared;
+    for ( document::Image* image : collector.images )
+    {
+        int index = shared.add(image->image());
+        if ( index == encoded_images.size() )
+        {
+            encoded_images.push_back(QtConcurrent::run(encodeImage, image->image(), suffix));
+            image_uses.push_back(0);
+        }
+        image_uses[index]++;
+        image_indices.push_back(index);
+    }
+
     writer.writeStartElement("document");
     writeId(document);
     writer.writeAttribute("width", QString::number(document.imageSize().width()));
@@ -112,6 +200,22 @@ void SaverXml::visit(document::Image& image)
     if ( image.frame() )
         writeId(*image.frame(), "frame");
 
+    // Distinct images are written in order, the first image with some
+    // contents declares its index in the file and the others refer to it.
+    // enter(Document) collected the images in this same visiting order
+    Q_ASSERT(!image_indices.empty());
+    int index = image_indices.takeFirst();
+    if ( index < written_images )
+    {
+        writer.writeAttribute("shared", QString::number(index));
+        writeMetadata(image.metadata());
+        writer.writeEndElement();
+        return;
+    }
+    written_images++;
+    if ( image_uses[index] > 1 )
+        writer.writeAttribute("chunk", QString::number(index));
+
     if ( !image.metadata().empty() )
     {
         writeMetadata(image.metadata());
@@ -119,11 +223,7 @@ void SaverXml::visit(document::Image& image)
     }
 
     writer.writeAttribute("type", image_format.name());
-    QByteArray image_data;
-    QBuffer buffer(&image_data);
-    QImageWriter image_writer(&buffer, image_format.preferredSuffix().toLatin1());
-    image_writer.write(image.image());
-    writer.writeCharacters(image_data.toBase64());
+    writer.writeCharacters(encoded_images[index].result());
 
     if ( !image.metadata().empty() )
     {
@@ -168,6 +268,7 @@ void SaverXml::writeMetadata(const document::Metadata& data)
         writer.writeStartElement("entry");
         writer.writeAttribute("name", it.key());
         writer.writeCharacters(it.value());
+        writer.writeEndElement();
     }
 
     writer.writeEndElement();
@@ -181,94 +282,214 @@ void SaverXml::writeId(const document::DocumentElement& element, const QString&
 
 void LoaderXml::root()
 {
-    auto doc = requireElement(xml,"document");
+    if ( !xml.readNextStartElement() || xml.name() != "document" )
+    {
+        checkError();
+        error(tr("Expected <%1>").arg("document"));
+    }
+
     builder.beginDocument();
-    id(doc);
-    document_ = builder.currentDocument();
+    id();
     /// \todo file format version
-    document_->setImageSize(QSize(
-        doc.attribute("width","32").toInt(),
-        doc.attribute("height","32").toInt()
-                            ));
-    metadata(doc.firstChildElement("metadata"));
-    animations(doc.firstChildElement("animations"));
-    formats(doc.firstChildElement("formats"));
-    layers(doc);
-    builder.endDocument();
+    builder.currentDocument()->setImageSize(QSize(
+        attribute("width", "32").toInt(),
+        attribute("height", "32").toInt()
+    ));
+
+    while ( xml.readNextStartElement() )
+    {
+        if ( xml.name() == "metadata" )
+            metadata();
+        else if ( xml.name() == "animations" || xml.name() == "animation" )
+            animations();
+        else if ( xml.name() == "formats" )
+            formats();
+        else if ( xml.name() == "layer" )
+            layer();
+        else
+            xml.skipCurrentElement();
+    }
+    checkError();
+
+    for ( auto& decoded : decoded_images )
+    {
+        QImage image = decoded.second.result();
+        if ( !image.isNull() )
+            decoded.first->image() = image;
+    }
+    decoded_images.clear();
+    shared_images.clear();
+
+    document_ = builder.endDocument();
 }
 
-void LoaderXml::metadata(const QDomElement& node)
+void LoaderXml::metadata()
 {
-    if ( node.isNull() ) return;
-
     auto& meta = builder.currentElement()->metadata();
-    for ( auto data = node.firstChildElement("entry"); !data.isNull();
-            data = data.nextSiblingElement("entry") )
+    while ( xml.readNextStartElement() )
+    {
+        if ( xml.name() != "entry" )
+        {
+            xml.skipCurrentElement();
+            continue;
+        }
+
+        bool named = xml.attributes().hasAttribute("name");
+        QString name = attribute("name");
+        QString value = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+        if ( named )
+            meta[name] = value;
+    }
+}
+
+void LoaderXml::animations()
+{
+    if ( xml.name() == "animation" )
+    {
+        animation();
+        return;
+    }
+
+    while ( xml.readNextStartElement() )
     {
-        if ( data.hasAttribute("name") )
-            meta[data.attribute("name")] = data.text();
+        if ( xml.name() == "animation" )
+            animation();
+        else
+            xml.skipCurrentElement();
     }
 }
 
-void LoaderXml::layers(const QDomElement& node)
+void LoaderXml::animation()
 {
-    for ( auto lay = node.firstChildElement("layer"); !lay.isNull();
-            lay = lay.nextSiblingElement("layer") )
+    document::Animation* animation = builder.beginAnimation();
+    id();
+    animation->setName(attribute("name"));
+    animation->setFramesPerSecond(qMax(1, attribute("fps", "24").toInt()));
+
+    while ( xml.readNextStartElement() )
     {
-        layer(lay);
+        if ( xml.name() == "metadata" )
+            metadata();
+        else if ( xml.name() == "frame" )
+            frame();
+        else
+            xml.skipCurrentElement();
     }
+
+    builder.endAnimation();
 }
 
-void LoaderXml::layer(const QDomElement& node)
+void LoaderXml::frame()
 {
-    document::Layer* layer = builder.beginLayer();
-    id(node);
-    layer->setName(node.attribute("name", tr("Layer")));
-    layer->setOpacity(node.attribute("opacity", "1").toDouble());
-    layer->setVisible(node.attribute("visible", "1").toInt());
-    layer->setLocked(node.attribute("locked", "0").toInt());
-    layer->setBlendMode(misc::composition_from_string(node.attribute("blend")));
-    layer->setBackgroundColor(color_widgets::colorFromString(node.attribute("background")));
-
-    metadata(node);
-
-    for ( auto img = node.firstChildElement("image"); !img.isNull();
-            img = img.nextSiblingElement("image") )
+    builder.beginFrame(attribute("id"));
+    id();
+
+    while ( xml.readNextStartElement() )
     {
-        image(img);
+        if ( xml.name() == "metadata" )
+            metadata();
+        else
+            xml.skipCurrentElement();
+    }
+
+    builder.endFrame();
+}
+
+void LoaderXml::layer()
+{
+    document::Layer* lay = builder.beginLayer();
+    id();
+    lay->setName(attribute("name", tr("Layer")));
+    lay->setOpacity(attribute("opacity", "1").toDouble());
+    lay->setVisible(attribute("visible", "1").toInt());
+    lay->setLocked(attribute("locked", "0").toInt());
+    lay->setBlendMode(misc::composition_from_string(attribute("blend")));
+    lay->setBackgroundColor(color_widgets::colorFromString(attribute("background")));
+
+    while ( xml.readNextStartElement() )
+    {
+        if ( xml.name() == "metadata" )
+            metadata();
+        else if ( xml.name() == "image" )
+            image();
+        else if ( xml.name() == "layer" )
+            layer();
+        else
+            xml.skipCurrentElement();
     }
 
-    layers(node);
     builder.endLayer();
 }
 
-void LoaderXml::image(const QDomElement& node)
+void LoaderXml::image()
 {
     builder.beginImage();
-    id(node);
-    builder.setImageFrame(node.attribute("frame"));
-    metadata(node);
-    auto bitmap_node = node.firstChildElement("bitmap");
-    if ( bitmap_node.isNull() )
-        bitmap(node);
+    id();
+    builder.setImageFrame(attribute("frame"));
+
+    QString shared = attribute("shared");
+    QString chunk = attribute("chunk");
+    QString type = attribute("type");
+    QByteArray image_data;
+    bitmap(image_data, type);
+
+    // Shared images are decoded once and keep sharing their pixels
+    auto iter = shared_images.find(shared);
+    if ( !shared.isEmpty() && iter != shared_images.end() )
+    {
+        decoded_images.push_back(qMakePair(builder.currentImage(), *iter));
+    }
     else
-        bitmap(bitmap_node);
+    {
+        auto content_type = mimeType(type, "image/png");
+        auto future = QtConcurrent::run(decodeImage, image_data, content_type.preferredSuffix().toUtf8());
+        decoded_images.push_back(qMakePair(builder.currentImage(), future));
+        if ( !chunk.isEmpty() )
+            shared_images.insert(chunk, future);
+    }
+
     builder.endImage();
 }
 
-void LoaderXml::bitmap(const QDomElement& node)
+void LoaderXml::bitmap(QByteArray& data, QString& type)
 {
-    auto content_type = mimeType(node.attribute("type"), "image/png");
-    QByteArray image_data = QByteArray::fromBase64(node.text().toLatin1());
-    QBuffer buffer(&image_data);
-    QImageReader reader(&buffer, content_type.preferredSuffix().toUtf8());
-    reader.read(&builder.currentImage()->image());
+    Base64Decoder decoder(data);
+    while ( !xml.atEnd() )
+    {
+        switch ( xml.readNext() )
+        {
+            case QXmlStreamReader::Characters:
+                decoder.feed(xml.text());
+                break;
+            case QXmlStreamReader::StartElement:
+                if ( xml.name() == "metadata" )
+                {
+                    metadata();
+                }
+                else if ( xml.name() == "bitmap" )
+                {
+                    type = attribute("type", type);
+                    bitmap(data, type);
+                }
+                else
+                {
+                    xml.skipCurrentElement();
+                }
+                break;
+            case QXmlStreamReader::EndElement:
+                decoder.finish();
+                return;
+            default:
+                break;
+        }
+    }
+    checkError();
 }
 
-void LoaderXml::id(const QDomElement& node)
+void LoaderXml::id()
 {
-    if ( node.hasAttribute("id") )
-        builder.currentElement()->setObjectName(node.attribute("id"));
+    if ( xml.attributes().hasAttribute("id") )
+        builder.currentElement()->setObjectName(attribute("id"));
 }
 
 } // namespace document
@@ -23,9 +23,10 @@
 
 
 #include <QXmlStreamWriter>
+#include <QXmlStreamReader>
 #include <QBuffer>
+#include <QFuture>
 #include <QMimeType>
-#include <QDomDocument>
 
 #include "formats.hpp"
 #include "document/builder.hpp"
@@ -34,6 +35,11 @@ namespace io {
 
 /**
  * \brief Visitor that recursively writes XML on a IODevice
+ *
+ * Image payloads are encoded on the global thread pool as soon as the
+ * document is entered, the writer only waits for the one it needs next.
+ * Images identical to a previous one reference it with the \c shared
+ * attribute instead of storing the data again.
  */
 class SaverXml : public document::Visitor
 {
@@ -57,8 +63,21 @@ private:
     QXmlStreamWriter writer;
 
     QMimeType image_format;
+    QList<QFuture<QByteArray>> encoded_images;  ///< One per distinct image
+    QList<int> image_indices;                   ///< Distinct image for each visited image
+    QVector<int> image_uses;                    ///< Visited images for each distinct image
+    int written_images = 0;                     ///< Distinct images already written
 };
 
+/**
+ * \brief Reads a document from XML
+ *
+ * The input is parsed as a stream, elements are passed to the builder as
+ * they are read and image data is decoded as it arrives, without keeping
+ * the whole XML tree in memory.
+ * Image payloads are decompressed on the global thread pool and assigned
+ * to their images once the whole document has been read.
+ */
 class LoaderXml
 {
     Q_DECLARE_TR_FUNCTIONS(FormatXmlMela)
@@ -72,18 +91,15 @@ public:
     };
 
     LoaderXml(QIODevice* device)
+        : xml(device)
     {
-        QString error_msg;
-        int error_line = 0;
-        int error_column = 0;
-        bool ok = xml.setContent(device, &error_msg, &error_line, &error_column);
         file_name = misc::fileName(device, tr("stream"));
-        if ( !ok )
-            error(error_msg, error_line, error_column);
     }
 
     ~LoaderXml()
     {
+        for ( auto& decoded : decoded_images )
+            decoded.second.waitForFinished();
         delete builder.currentDocument();
     }
 
@@ -107,36 +123,47 @@ private:
             .arg(file_name).arg(message));
     }
 
-    QDomElement requireElement(const QDomNode& node, const QString& name)
+    /**
+     * \brief Throws if the reader has encountered an error
+     */
+    void checkError()
     {
-        auto element = node.firstChildElement(name);
-        if ( element.isNull() )
-            error(tr("Expected <%1>").arg(name));
-        return element;
+        if ( xml.hasError() )
+            error(xml.errorString(), xml.lineNumber(), xml.columnNumber());
     }
 
-    void root();
-
-    void animations(const QDomElement& node)
+    /**
+     * \brief Attribute of the current element
+     */
+    QString attribute(const QString& name, const QString& default_value = QString())
     {
-        if ( node.isNull() ) return;
-        /// \todo Animations
+        auto attributes = xml.attributes();
+        if ( attributes.hasAttribute(name) )
+            return attributes.value(name).toString();
+        return default_value;
     }
 
-    void formats(const QDomElement& node)
+    void root();
+
+    void animations();
+    void animation();
+    void frame();
+
+    void formats()
     {
-        if ( node.isNull() ) return;
         /// \todo read document_->formatSettings()
+        xml.skipCurrentElement();
     }
 
-    void metadata(const QDomElement& node);
-    void layers(const QDomElement& node);
-    void layer(const QDomElement& node);
-    void image(const QDomElement& node);
-    void bitmap(const QDomElement& node);
-    void id(const QDomElement& node);
+    void metadata();
+    void layer();
+    void image();
+    void bitmap(QByteArray& data, QString& type);
+    void id();
 
-    QDomDocument xml;
+    QXmlStreamReader xml;
+    QList<QPair<document::Image*, QFuture<QImage>>> decoded_images;
+    QHash<QString, QFuture<QImage>> shared_images; ///< Decoded images by chunk index
     document::Builder builder;
     document::Document* document_ = nullptr;
     QString file_name;
@@ -165,7 +192,15 @@ protected:
 
     document::Document* onOpen(QIODevice* device) override
     {
-        return LoaderXml(device).document();
+        try
+        {
+            return LoaderXml(device).document();
+        }
+        catch ( const LoaderXml::XmlError& exc )
+        {
+            setError(QString::fromStdString(exc.what()));
+            return nullptr;
+        }
     }
 };
 
@@ -24,15 +24,24 @@
 #include "ui/dialogs/main_window.hpp"
 #include "cayman/message.hpp"
 #include "cayman/application.hpp"
+#include "cayman/batch.hpp"
 
 int main(int argc, char** argv)
 {
+    cayman::Batch batch(argc, argv);
     cayman::Application app(argc, argv);
     try
     {
         app.initSubsystems();
+
+        if ( batch.enabled() )
+            return batch.run();
+
         MainWindow window;
+        app.startupPhase("main window");
         window.show();
+        app.startupPhase("show");
+        app.reportStartup();
         return app.exec();
     }
     catch ( const std::exception& exc )
@@ -22,26 +22,51 @@
 
 #include "color.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
 namespace misc {
 namespace color {
 
-int to4bit(const QColor& c) noexcept
+namespace {
+
+using Table = std::array<uchar, 1 << 15>;
+
+int lutKey(QRgb color)
+{
+    return ((qRed(color) >> 3) << 10) | ((qGreen(color) >> 3) << 5) | (qBlue(color) >> 3);
+}
+
+/**
+ * \brief Representative channel value of a lookup table cell
+ *
+ * The 5 bits are replicated into the low bits, so the first and last
+ * cells map to exactly 0 and 255 rather than to the center of the cell.
+ */
+int lutChannel(int key, int shift)
+{
+    int value = (key >> shift) & 31;
+    return (value << 3) | (value >> 2);
+}
+
+int compute4bit(int red, int green, int blue)
 {
     int color = 0;
 
-    float cmax = std::max({c.red(),c.green(),c.blue()});
-    float cmin = std::min({c.red(),c.green(),c.blue()});
+    float cmax = std::max({red, green, blue});
+    float cmin = std::min({red, green, blue});
     float delta = cmax-cmin;
 
     if ( delta > 0 )
     {
         float hue = 0;
-        if ( c.red() == cmax )
-            hue = (c.green()-c.blue())/delta;
-        else if ( c.green() == cmax )
-            hue = (c.blue()-c.red())/delta + 2;
-        else if ( c.blue() == cmax )
-            hue = (c.red()-c.green())/delta + 4;
+        if ( red == cmax )
+            hue = (green-blue)/delta;
+        else if ( green == cmax )
+            hue = (blue-red)/delta + 2;
+        else if ( blue == cmax )
+            hue = (red-green)/delta + 4;
 
         float sat = delta / cmax;
         if ( sat >= 0.3 )
@@ -78,5 +103,102 @@ int to4bit(const QColor& c) noexcept
     return color;
 }
 
+int computeXterm256(int red, int green, int blue)
+{
+    static const int levels[] = {0, 95, 135, 175, 215, 255};
+    auto closest_level = [](int value) {
+        int best = 0;
+        for ( int i = 1; i < 6; i++ )
+            if ( std::abs(levels[i] - value) < std::abs(levels[best] - value) )
+                best = i;
+        return best;
+    };
+    auto distance = [red, green, blue](int r, int g, int b) {
+        return (r - red) * (r - red) + (g - green) * (g - green) + (b - blue) * (b - blue);
+    };
+
+    int r = closest_level(red);
+    int g = closest_level(green);
+    int b = closest_level(blue);
+    int cube_distance = distance(levels[r], levels[g], levels[b]);
+
+    int gray = qBound(0, ((red + green + blue) / 3 - 3) / 10, 23);
+    int gray_value = 8 + gray * 10;
+    int gray_distance = distance(gray_value, gray_value, gray_value);
+
+    if ( gray_distance < cube_distance )
+        return 232 + gray;
+    return 16 + r * 36 + g * 6 + b;
+}
+
+template<class Func>
+    Table makeTable(Func func)
+    {
+        Table table;
+        for ( int key = 0; key < int(table.size()); key++ )
+            table[key] = func(lutChannel(key, 10), lutChannel(key, 5), lutChannel(key, 0));
+        return table;
+    }
+
+const Table& table4bit()
+{
+    static const Table table = makeTable(compute4bit);
+    return table;
+}
+
+const Table& tableXterm256()
+{
+    static const Table table = makeTable(computeXterm256);
+    return table;
+}
+
+} // namespace
+
+int to4bit(const QColor& c) noexcept
+{
+    return table4bit()[lutKey(c.rgb())];
+}
+
+void to4bit(const QRgb* colors, int count, uchar* output) noexcept
+{
+    const Table& table = table4bit();
+    for ( int i = 0; i < count; i++ )
+        output[i] = table[lutKey(colors[i])];
+}
+
+int toXterm256(QRgb color) noexcept
+{
+    return tableXterm256()[lutKey(color)];
+}
+
+void toXterm256(const QRgb* colors, int count, uchar* output) noexcept
+{
+    const Table& table = tableXterm256();
+    for ( int i = 0; i < count; i++ )
+        output[i] = table[lutKey(colors[i])];
+}
+
+QRgb fromXterm256(int index) noexcept
+{
+    static const QRgb system[] = {
+        qRgb(0, 0, 0), qRgb(205, 0, 0), qRgb(0, 205, 0), qRgb(205, 205, 0),
+        qRgb(0, 0, 238), qRgb(205, 0, 205), qRgb(0, 205, 205), qRgb(229, 229, 229),
+        qRgb(127, 127, 127), qRgb(255, 0, 0), qRgb(0, 255, 0), qRgb(255, 255, 0),
+        qRgb(92, 92, 255), qRgb(255, 0, 255), qRgb(0, 255, 255), qRgb(255, 255, 255),
+    };
+    static const int levels[] = {0, 95, 135, 175, 215, 255};
+
+    index = qBound(0, index, 255);
+    if ( index < 16 )
+        return system[index];
+    if ( index < 232 )
+    {
+        index -= 16;
+        return qRgb(levels[index / 36], levels[index / 6 % 6], levels[index % 6]);
+    }
+    int gray = 8 + (index - 232) * 10;
+    return qRgb(gray, gray, gray);
+}
+
 } // namespace color
 } // namespace misc
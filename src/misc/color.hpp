@@ -37,6 +37,31 @@ namespace color {
  */
 int to4bit(const QColor& c) noexcept;
 
+/**
+ * \brief Maps \p count colors to the codes returned by to4bit()
+ *
+ * Both this and to4bit() use a lookup table on the 5 most significant
+ * bits of each channel.
+ */
+void to4bit(const QRgb* colors, int count, uchar* output) noexcept;
+
+/**
+ * \brief Index of the closest color in the xterm 256 color palette
+ *
+ * Only the color cube and the gray ramp are considered, since the first
+ * 16 entries depend on the terminal theme.
+ */
+int toXterm256(QRgb color) noexcept;
+
+/**
+ * \brief Maps \p count colors to the indices returned by toXterm256()
+ */
+void toXterm256(const QRgb* colors, int count, uchar* output) noexcept;
+
+/**
+ * \brief Color of an entry in the xterm 256 color palette
+ */
+QRgb fromXterm256(int index) noexcept;
 
 } // namespace color
 } // namespace misc
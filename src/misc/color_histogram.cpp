@@ -0,0 +1,112 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "color_histogram.hpp"
+
+#include <algorithm>
+
+namespace misc {
+
+ColorHistogram::ColorHistogram()
+    : table(1024, Entry{0, 0})
+{}
+
+void ColorHistogram::grow()
+{
+    std::vector<Entry> old(table.size() * 2, Entry{0, 0});
+    old.swap(table);
+    used = 0;
+    for ( const Entry& entry : old )
+        if ( entry.count )
+            add(entry.color, entry.count);
+}
+
+void ColorHistogram::add(const QImage& image, int begin, int end)
+{
+    int width = image.width();
+
+    if ( image.format() == QImage::Format_Indexed8 )
+    {
+        quint32 counts[256] = {0};
+        for ( int y = begin; y < end; y++ )
+        {
+            const uchar* line = image.constScanLine(y);
+            for ( int x = 0; x < width; x++ )
+                counts[line[x]]++;
+        }
+        for ( int i = 0; i < image.colorCount(); i++ )
+            add(image.color(i), counts[i]);
+        return;
+    }
+
+    // Runs of the same color are counted before looking them up
+    QRgb last = 0;
+    quint32 run = 0;
+    for ( int y = begin; y < end; y++ )
+    {
+        const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for ( int x = 0; x < width; x++ )
+        {
+            if ( run && line[x] == last )
+            {
+                run++;
+            }
+            else
+            {
+                add(last, run);
+                last = line[x];
+                run = 1;
+            }
+        }
+    }
+    add(last, run);
+}
+
+void ColorHistogram::merge(const ColorHistogram& other)
+{
+    for ( const Entry& entry : other.table )
+        if ( entry.count )
+            add(entry.color, entry.count);
+}
+
+QVector<ColorHistogram::Entry> ColorHistogram::entries() const
+{
+    QVector<Entry> result;
+    result.reserve(used);
+    for ( const Entry& entry : table )
+        if ( entry.count )
+            result.push_back(entry);
+    return result;
+}
+
+QVector<QRgb> ColorHistogram::colors() const
+{
+    QVector<QRgb> result;
+    result.reserve(used);
+    for ( const Entry& entry : table )
+        if ( entry.count )
+            result.push_back(entry.color);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+} // namespace misc
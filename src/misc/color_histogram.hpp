@@ -0,0 +1,120 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_MISC_COLOR_HISTOGRAM_HPP
+#define PIXEL_CAYMAN_MISC_COLOR_HISTOGRAM_HPP
+
+#include <vector>
+
+#include <QImage>
+#include <QVector>
+
+namespace misc {
+
+/**
+ * \brief Counts how many pixels use each color
+ *
+ * Open addressing hash table with linear probing, it avoids the per-node
+ * allocations of QHash for the millions of insertions needed to scan
+ * an image.
+ */
+class ColorHistogram
+{
+public:
+    struct Entry
+    {
+        QRgb color;
+        quint32 count; ///< Zero for empty slots
+    };
+
+    ColorHistogram();
+
+    /**
+     * \brief Adds \p count pixels of the given color
+     */
+    void add(QRgb color, quint32 count = 1)
+    {
+        if ( count == 0 )
+            return;
+
+        quint32 mask = table.size() - 1;
+        for ( quint32 i = hash(color) & mask; ; i = (i + 1) & mask )
+        {
+            Entry& entry = table[i];
+            if ( entry.count == 0 )
+            {
+                entry.color = color;
+                entry.count = count;
+                if ( ++used * 2 > table.size() )
+                    grow();
+                return;
+            }
+            if ( entry.color == color )
+            {
+                entry.count += count;
+                return;
+            }
+        }
+    }
+
+    /**
+     * \brief Adds the pixels in the rows [\p begin, \p end) of \p image
+     */
+    void add(const QImage& image, int begin, int end);
+
+    /**
+     * \brief Adds the counts from \p other
+     */
+    void merge(const ColorHistogram& other);
+
+    /**
+     * \brief Number of distinct colors
+     */
+    int size() const
+    {
+        return used;
+    }
+
+    /**
+     * \brief Colors and their counts, in no particular order
+     */
+    QVector<Entry> entries() const;
+
+    /**
+     * \brief Distinct colors, sorted by value
+     */
+    QVector<QRgb> colors() const;
+
+private:
+    static quint32 hash(QRgb color)
+    {
+        quint32 mix = color ^ (color >> 16);
+        mix *= 0x45d9f3b;
+        return mix ^ (mix >> 16);
+    }
+
+    void grow();
+
+    std::vector<Entry> table;
+    std::size_t used = 0;
+};
+
+} // namespace misc
+#endif // PIXEL_CAYMAN_MISC_COLOR_HISTOGRAM_HPP
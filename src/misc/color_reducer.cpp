@@ -0,0 +1,442 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "color_reducer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace misc {
+
+namespace {
+
+/// Histograms with more colors are grouped by their 15 bit value first
+const int max_buckets = 1 << 15;
+
+double distance(double r1, double g1, double b1, double r2, double g2, double b2)
+{
+    double dr = r1 - r2;
+    double dg = g1 - g2;
+    double db = b1 - b2;
+    return dr * dr + dg * dg + db * db;
+}
+
+} // namespace
+
+QVector<QRgb> ColorReducer::reduce(const ColorHistogram& histogram, const Progress& progress) const
+{
+    Buckets input;
+    bool transparent = false;
+    QVector<ColorHistogram::Entry> entries = histogram.entries();
+
+    if ( entries.size() > max_buckets )
+    {
+        Buckets cells(max_buckets, Bucket{0, 0, 0, 0});
+        for ( const auto& entry : entries )
+        {
+            if ( qAlpha(entry.color) < 128 )
+            {
+                transparent = true;
+                continue;
+            }
+            Bucket& cell = cells[((qRed(entry.color) >> 3) << 10) |
+                                 ((qGreen(entry.color) >> 3) << 5) |
+                                  (qBlue(entry.color) >> 3)];
+            cell.red += qRed(entry.color) * double(entry.count);
+            cell.green += qGreen(entry.color) * double(entry.count);
+            cell.blue += qBlue(entry.color) * double(entry.count);
+            cell.weight += entry.count;
+        }
+        for ( const auto& cell : cells )
+            if ( cell.weight > 0 )
+                input.push_back({cell.red / cell.weight, cell.green / cell.weight,
+                                 cell.blue / cell.weight, cell.weight});
+    }
+    else
+    {
+        for ( const auto& entry : entries )
+        {
+            if ( qAlpha(entry.color) < 128 )
+                transparent = true;
+            else
+                input.push_back({double(qRed(entry.color)), double(qGreen(entry.color)),
+                                 double(qBlue(entry.color)), double(entry.count)});
+        }
+    }
+
+    int count = colors - (transparent ? 1 : 0);
+    Buckets result;
+    if ( count > 0 && !input.isEmpty() )
+    {
+        if ( input.size() <= count )
+        {
+            result = input;
+        }
+        else
+        {
+            switch ( algorithm )
+            {
+                case Algorithm::MedianCut:
+                    result = medianCut(input, count, progress);
+                    break;
+                case Algorithm::Octree:
+                    result = octree(input, count, progress);
+                    break;
+                case Algorithm::KMeans:
+                    result = kMeans(input, count, progress);
+                    break;
+            }
+
+            // Cancelled
+            if ( result.isEmpty() )
+                return {};
+        }
+    }
+
+    QVector<QRgb> palette;
+    for ( const auto& bucket : result )
+        palette.push_back(qRgb(qRound(bucket.red), qRound(bucket.green), qRound(bucket.blue)));
+    if ( transparent )
+        palette.push_back(qRgba(0, 0, 0, 0));
+
+    if ( progress )
+        progress(100);
+    return palette;
+}
+
+ColorReducer::Buckets ColorReducer::medianCut(const Buckets& input, int count, const Progress& progress) const
+{
+    struct Box
+    {
+        int begin;
+        int end;
+    };
+
+    auto channel = [](const Bucket& bucket, int index) {
+        return index == 0 ? bucket.red : index == 1 ? bucket.green : bucket.blue;
+    };
+
+    Buckets items = input;
+    QVector<Box> boxes{{0, items.size()}};
+
+    while ( boxes.size() < count )
+    {
+        // Split the box with the widest range on any channel
+        int best = -1;
+        int best_channel = 0;
+        double best_range = 0;
+        for ( int i = 0; i < boxes.size(); i++ )
+        {
+            if ( boxes[i].end - boxes[i].begin < 2 )
+                continue;
+
+            double min[3] = {255, 255, 255};
+            double max[3] = {0, 0, 0};
+            for ( int j = boxes[i].begin; j < boxes[i].end; j++ )
+            {
+                for ( int c = 0; c < 3; c++ )
+                {
+                    min[c] = std::min(min[c], channel(items[j], c));
+                    max[c] = std::max(max[c], channel(items[j], c));
+                }
+            }
+
+            for ( int c = 0; c < 3; c++ )
+            {
+                if ( max[c] - min[c] > best_range )
+                {
+                    best = i;
+                    best_channel = c;
+                    best_range = max[c] - min[c];
+                }
+            }
+        }
+
+        if ( best == -1 )
+            break;
+
+        Box box = boxes[best];
+        std::sort(items.begin() + box.begin, items.begin() + box.end,
+            [&channel, best_channel](const Bucket& a, const Bucket& b) {
+                return channel(a, best_channel) < channel(b, best_channel);
+        });
+
+        // Split at the weighted median, keeping at least an item per side
+        double total = 0;
+        for ( int j = box.begin; j < box.end; j++ )
+            total += items[j].weight;
+        double half = 0;
+        int split = box.begin + 1;
+        for ( ; split < box.end - 1; split++ )
+        {
+            half += items[split - 1].weight;
+            if ( half >= total / 2 )
+                break;
+        }
+
+        boxes[best].end = split;
+        boxes.push_back({split, box.end});
+
+        if ( progress && !progress(boxes.size() * 100 / count) )
+            return {};
+    }
+
+    Buckets result;
+    for ( const Box& box : boxes )
+    {
+        Bucket sum{0, 0, 0, 0};
+        for ( int j = box.begin; j < box.end; j++ )
+        {
+            sum.red += items[j].red * items[j].weight;
+            sum.green += items[j].green * items[j].weight;
+            sum.blue += items[j].blue * items[j].weight;
+            sum.weight += items[j].weight;
+        }
+        result.push_back({sum.red / sum.weight, sum.green / sum.weight,
+                          sum.blue / sum.weight, sum.weight});
+    }
+    return result;
+}
+
+ColorReducer::Buckets ColorReducer::octree(const Buckets& input, int count, const Progress& progress) const
+{
+    const int max_depth = 8;
+
+    struct Node
+    {
+        Node()
+        {
+            std::fill(std::begin(children), std::end(children), -1);
+        }
+
+        Bucket sum{0, 0, 0, 0};
+        int children[8];
+        int child_count = 0;
+        bool leaf = false;
+    };
+
+    std::vector<Node> nodes(1);
+    std::vector<std::vector<int>> reducible(max_depth);
+    int leaves = 0;
+
+    for ( const auto& bucket : input )
+    {
+        int red = qBound(0, qRound(bucket.red), 255);
+        int green = qBound(0, qRound(bucket.green), 255);
+        int blue = qBound(0, qRound(bucket.blue), 255);
+
+        int node = 0;
+        for ( int level = 0; level < max_depth; level++ )
+        {
+            int shift = 7 - level;
+            int index = (((red >> shift) & 1) << 2) |
+                        (((green >> shift) & 1) << 1) |
+                         ((blue >> shift) & 1);
+            int child = nodes[node].children[index];
+            if ( child == -1 )
+            {
+                child = nodes.size();
+                nodes.emplace_back();
+                nodes[node].children[index] = child;
+                if ( nodes[node].child_count++ == 0 )
+                    reducible[level].push_back(node);
+            }
+            node = child;
+        }
+
+        Node& leaf = nodes[node];
+        if ( !leaf.leaf )
+        {
+            leaf.leaf = true;
+            leaves++;
+        }
+        leaf.sum.red += bucket.red * bucket.weight;
+        leaf.sum.green += bucket.green * bucket.weight;
+        leaf.sum.blue += bucket.blue * bucket.weight;
+        leaf.sum.weight += bucket.weight;
+    }
+
+    if ( progress && !progress(30) )
+        return {};
+
+    // Merge the children of the deepest nodes first, at each level
+    // the nodes with the fewest pixels are merged first.
+    // By the time a level is processed all of its children are leaves.
+    int initial_leaves = leaves;
+    for ( int level = max_depth - 1; level >= 0 && leaves > count; level-- )
+    {
+        std::vector<int>& level_nodes = reducible[level];
+        for ( int index : level_nodes )
+        {
+            Node& node = nodes[index];
+            for ( int child : node.children )
+                if ( child != -1 )
+                    node.sum.weight += nodes[child].sum.weight;
+        }
+        std::sort(level_nodes.begin(), level_nodes.end(), [&nodes](int a, int b) {
+            return nodes[a].sum.weight < nodes[b].sum.weight;
+        });
+
+        for ( int index : level_nodes )
+        {
+            if ( leaves <= count )
+                break;
+
+            Node& node = nodes[index];
+            node.sum.weight = 0;
+            for ( int& child : node.children )
+            {
+                if ( child == -1 )
+                    continue;
+                Node& child_node = nodes[child];
+                node.sum.red += child_node.sum.red;
+                node.sum.green += child_node.sum.green;
+                node.sum.blue += child_node.sum.blue;
+                node.sum.weight += child_node.sum.weight;
+                child_node.leaf = false;
+                child = -1;
+            }
+            node.leaf = true;
+            leaves -= node.child_count - 1;
+            node.child_count = 0;
+        }
+
+        if ( progress && !progress(30 + 60 * (initial_leaves - leaves) /
+                                         qMax(1, initial_leaves - count)) )
+            return {};
+    }
+
+    Buckets result;
+    for ( const Node& node : nodes )
+        if ( node.leaf && node.sum.weight > 0 )
+            result.push_back({node.sum.red / node.sum.weight, node.sum.green / node.sum.weight,
+                              node.sum.blue / node.sum.weight, node.sum.weight});
+    return result;
+}
+
+ColorReducer::Buckets ColorReducer::kMeans(const Buckets& input, int count, const Progress& progress) const
+{
+    const int max_iterations = 32;
+
+    // Fixed seed so the same image always gives the same palette
+    std::mt19937 random(0x5eed);
+    auto pick = [&random](const std::vector<double>& weights, double total) {
+        double target = std::uniform_real_distribution<double>(0, total)(random);
+        for ( std::size_t i = 0; i < weights.size(); i++ )
+        {
+            target -= weights[i];
+            if ( target < 0 )
+                return int(i);
+        }
+        return int(weights.size() - 1);
+    };
+
+    // k-means++ seeding: each center is chosen with a probability
+    // proportional to its squared distance from the closest center
+    int size = input.size();
+    std::vector<double> weights(size);
+    std::vector<double> nearest(size, std::numeric_limits<double>::max());
+    double total = 0;
+    for ( int i = 0; i < size; i++ )
+        total += weights[i] = input[i].weight;
+
+    Buckets centers;
+    centers.push_back(input[pick(weights, total)]);
+    while ( centers.size() < count )
+    {
+        const Bucket& last = centers.back();
+        total = 0;
+        for ( int i = 0; i < size; i++ )
+        {
+            nearest[i] = std::min(nearest[i], distance(input[i].red, input[i].green, input[i].blue,
+                                                       last.red, last.green, last.blue));
+            total += weights[i] = nearest[i] * input[i].weight;
+        }
+        if ( total <= 0 )
+            break;
+        centers.push_back(input[pick(weights, total)]);
+
+        if ( progress && !progress(centers.size() * 30 / count) )
+            return {};
+    }
+
+    // Lloyd iterations
+    QVector<int> assignment(size, -1);
+    for ( int iteration = 0; iteration < max_iterations; iteration++ )
+    {
+        bool changed = false;
+        Buckets sums(centers.size(), Bucket{0, 0, 0, 0});
+        for ( int i = 0; i < size; i++ )
+        {
+            const Bucket& item = input[i];
+            int best = 0;
+            double best_distance = std::numeric_limits<double>::max();
+            for ( int c = 0; c < centers.size(); c++ )
+            {
+                double dist = distance(item.red, item.green, item.blue,
+                                       centers[c].red, centers[c].green, centers[c].blue);
+                if ( dist < best_distance )
+                {
+                    best = c;
+                    best_distance = dist;
+                }
+            }
+
+            if ( assignment[i] != best )
+            {
+                assignment[i] = best;
+                changed = true;
+            }
+
+            Bucket& sum = sums[best];
+            sum.red += item.red * item.weight;
+            sum.green += item.green * item.weight;
+            sum.blue += item.blue * item.weight;
+            sum.weight += item.weight;
+        }
+
+        for ( int c = 0; c < centers.size(); c++ )
+        {
+            if ( sums[c].weight > 0 )
+                centers[c] = {sums[c].red / sums[c].weight, sums[c].green / sums[c].weight,
+                              sums[c].blue / sums[c].weight, sums[c].weight};
+            else
+                centers[c].weight = 0;
+        }
+
+        if ( !changed )
+            break;
+
+        if ( progress && !progress(30 + 70 * (iteration + 1) / max_iterations) )
+            return {};
+    }
+
+    Buckets result;
+    for ( const Bucket& center : centers )
+        if ( center.weight > 0 )
+            result.push_back(center);
+    return result;
+}
+
+} // namespace misc
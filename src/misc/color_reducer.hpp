@@ -0,0 +1,83 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_MISC_COLOR_REDUCER_HPP
+#define PIXEL_CAYMAN_MISC_COLOR_REDUCER_HPP
+
+#include <functional>
+
+#include "color_histogram.hpp"
+
+namespace misc {
+
+/**
+ * \brief Generates a palette with a limited number of colors which
+ *        approximates the colors in a histogram
+ */
+class ColorReducer
+{
+public:
+    enum class Algorithm
+    {
+        MedianCut,  ///< Recursively splits the color space at the median
+        Octree,     ///< Merges the leaves of an octree of the colors
+        KMeans,     ///< K-means clustering with k-means++ seeding
+    };
+
+    /**
+     * \brief Called with the progress percentage,
+     *        returning \b false cancels the operation
+     */
+    using Progress = std::function<bool (int percent)>;
+
+    ColorReducer(Algorithm algorithm, int colors)
+        : algorithm(algorithm), colors(qBound(1, colors, 256))
+    {}
+
+    /**
+     * \brief Computes the palette
+     *
+     * Colors with less than half opacity are represented by a single transparent entry.
+     * \returns The palette, empty if cancelled
+     */
+    QVector<QRgb> reduce(const ColorHistogram& histogram,
+                         const Progress& progress = Progress()) const;
+
+private:
+    struct Bucket
+    {
+        double red;
+        double green;
+        double blue;
+        double weight;
+    };
+
+    using Buckets = QVector<Bucket>;
+
+    Buckets medianCut(const Buckets& input, int count, const Progress& progress) const;
+    Buckets octree(const Buckets& input, int count, const Progress& progress) const;
+    Buckets kMeans(const Buckets& input, int count, const Progress& progress) const;
+
+    Algorithm algorithm;
+    int colors;
+};
+
+} // namespace misc
+#endif // PIXEL_CAYMAN_MISC_COLOR_REDUCER_HPP
@@ -21,7 +21,8 @@
 #ifndef PIXEL_CAYMAN_MISC_HPP
 #define PIXEL_CAYMAN_MISC_HPP
 
-#include <QFile>
+#include <QFileDevice>
+#include "write_behind_device.hpp"
 
 namespace misc {
 
@@ -30,8 +31,10 @@ namespace misc {
  */
 inline QString fileName(const QIODevice* device, const QString& def = QString())
 {
-    if ( const QFile* file = qobject_cast<const QFile*>(device) )
+    if ( const QFileDevice* file = qobject_cast<const QFileDevice*>(device) )
         return file->fileName();
+    if ( const WriteBehindDevice* buffer = qobject_cast<const WriteBehindDevice*>(device) )
+        return fileName(buffer->target(), def);
     return def;
 }
 
@@ -0,0 +1,235 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "quantizer.hpp"
+
+#include <climits>
+#include <numeric>
+
+#include <QtConcurrent>
+
+namespace misc {
+
+namespace {
+
+const int lut_size = 1 << 15;
+
+/// Rows converted by each thread when there's no error diffusion
+const int rows_per_task = 64;
+
+const int bayer[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+inline int clamp(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+} // namespace
+
+Quantizer::Quantizer(const QVector<QRgb>& color_table)
+    : table(color_table.mid(0, 256))
+{
+    if ( table.isEmpty() )
+        return;
+
+    // Iterate backwards so duplicate colors map to the first entry
+    for ( int i = table.size() - 1; i >= 0; i-- )
+    {
+        QRgb color = table[i];
+        if ( qAlpha(color) < 128 )
+        {
+            transparent = i;
+        }
+        else
+        {
+            exact[color | 0xff000000] = i;
+        }
+    }
+
+    ambiguous.resize(lut_size);
+    for ( auto it = exact.begin(); it != exact.end(); ++it )
+        ambiguous.setBit(lutKey(it.key()));
+
+    lut.resize(lut_size);
+    uchar* cells = lut.data();
+    QVector<int> reds(32);
+    std::iota(reds.begin(), reds.end(), 0);
+    QtConcurrent::blockingMap(reds, [this, cells](int red) {
+        for ( int green = 0; green < 32; green++ )
+            for ( int blue = 0; blue < 32; blue++ )
+                cells[(red << 10) | (green << 5) | blue] =
+                    closest(red * 8 + 4, green * 8 + 4, blue * 8 + 4);
+    });
+}
+
+int Quantizer::closest(int red, int green, int blue) const
+{
+    // Transparent entries are only picked when there's nothing else
+    bool skip_transparent = !exact.isEmpty();
+
+    int best = 0;
+    int best_distance = INT_MAX;
+    for ( int i = 0; i < table.size(); i++ )
+    {
+        QRgb color = table[i];
+        if ( skip_transparent && qAlpha(color) < 128 )
+            continue;
+
+        int dr = qRed(color) - red;
+        int dg = qGreen(color) - green;
+        int db = qBlue(color) - blue;
+        int distance = 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+        if ( distance < best_distance )
+        {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+QImage Quantizer::quantize(const QImage& image, Dither dither) const
+{
+    if ( isNull() || image.isNull() )
+        return QImage();
+
+    QImage source = image;
+    if ( source.format() != QImage::Format_ARGB32 && source.format() != QImage::Format_RGB32 )
+        source = source.convertToFormat(QImage::Format_ARGB32);
+
+    QImage dest(source.size(), QImage::Format_Indexed8);
+    dest.setColorTable(table);
+    // Accessing the bits once so the threads don't detach the image
+    uchar* bits = dest.bits();
+    int bytes_per_line = dest.bytesPerLine();
+
+    if ( dither == Dither::FloydSteinberg )
+    {
+        diffuse(source, bits, bytes_per_line);
+    }
+    else if ( source.height() <= rows_per_task )
+    {
+        quantizeRows(source, bits, bytes_per_line, 0, source.height(), dither);
+    }
+    else
+    {
+        QVector<int> bands;
+        for ( int row = 0; row < source.height(); row += rows_per_task )
+            bands.push_back(row);
+        QtConcurrent::blockingMap(bands, [&](int begin) {
+            quantizeRows(source, bits, bytes_per_line, begin,
+                         qMin(begin + rows_per_task, source.height()), dither);
+        });
+    }
+
+    return dest;
+}
+
+void Quantizer::quantizeRows(const QImage& source, uchar* dest, int bytes_per_line,
+                             int begin, int end, Dither dither) const
+{
+    int width = source.width();
+    for ( int y = begin; y < end; y++ )
+    {
+        const QRgb* in = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        uchar* out = dest + y * bytes_per_line;
+
+        if ( dither == Dither::None )
+        {
+            for ( int x = 0; x < width; x++ )
+                out[x] = index(in[x]);
+            continue;
+        }
+
+        const int* threshold = bayer[y & 3];
+        for ( int x = 0; x < width; x++ )
+        {
+            QRgb pixel = in[x];
+            int offset = threshold[x & 3] * 2 - 15;
+            out[x] = index(qRgba(
+                clamp(qRed(pixel) + offset),
+                clamp(qGreen(pixel) + offset),
+                clamp(qBlue(pixel) + offset),
+                qAlpha(pixel)
+            ));
+        }
+    }
+}
+
+void Quantizer::diffuse(const QImage& source, uchar* dest, int bytes_per_line) const
+{
+    int width = source.width();
+
+    // Errors (times 16) for the current and the next row,
+    // with an extra pixel on both sides
+    QVector<int> errors_current((width + 2) * 3, 0);
+    QVector<int> errors_next((width + 2) * 3, 0);
+    int* current = errors_current.data();
+    int* next = errors_next.data();
+
+    for ( int y = 0; y < source.height(); y++ )
+    {
+        const QRgb* in = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        uchar* out = dest + y * bytes_per_line;
+        std::fill(next, next + (width + 2) * 3, 0);
+
+        for ( int x = 0; x < width; x++ )
+        {
+            QRgb pixel = in[x];
+            if ( qAlpha(pixel) < 128 && transparent != -1 )
+            {
+                out[x] = transparent;
+                continue;
+            }
+
+            int* error = current + (x + 1) * 3;
+            int channels[3] = {
+                clamp(qRed(pixel) + error[0] / 16),
+                clamp(qGreen(pixel) + error[1] / 16),
+                clamp(qBlue(pixel) + error[2] / 16),
+            };
+            int i = index(qRgb(channels[0], channels[1], channels[2]));
+            out[x] = i;
+
+            QRgb result = table[i];
+            int results[3] = { qRed(result), qGreen(result), qBlue(result) };
+            int* below = next + x * 3;
+            for ( int c = 0; c < 3; c++ )
+            {
+                int diff = channels[c] - results[c];
+                error[c + 3] += diff * 7;
+                below[c] += diff * 3;
+                below[c + 3] += diff * 5;
+                below[c + 6] += diff;
+            }
+        }
+
+        std::swap(current, next);
+    }
+}
+
+} // namespace misc
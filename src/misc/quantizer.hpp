@@ -0,0 +1,121 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_MISC_QUANTIZER_HPP
+#define PIXEL_CAYMAN_MISC_QUANTIZER_HPP
+
+#include <QBitArray>
+#include <QHash>
+#include <QImage>
+#include <QVector>
+
+namespace misc {
+
+/**
+ * \brief Maps colors to the closest entry of a color table
+ *
+ * The closest entry for each 15 bit color is computed once when the
+ * color table is set, colors matching a table entry exactly are always
+ * mapped to that entry.
+ */
+class Quantizer
+{
+public:
+    /**
+     * \brief How to distribute the error introduced by the quantization
+     */
+    enum class Dither
+    {
+        None,           ///< Closest color for each pixel
+        Ordered,        ///< Threshold with a Bayer matrix
+        FloydSteinberg, ///< Error diffusion
+    };
+
+    Quantizer() = default;
+    explicit Quantizer(const QVector<QRgb>& color_table);
+
+    const QVector<QRgb>& colorTable() const
+    {
+        return table;
+    }
+
+    /**
+     * \brief Whether there are no colors to map to
+     */
+    bool isNull() const
+    {
+        return table.isEmpty();
+    }
+
+    /**
+     * \brief Index of the entry closest to \p color
+     * \pre !isNull()
+     */
+    int index(QRgb color) const
+    {
+        if ( qAlpha(color) < 128 && transparent != -1 )
+            return transparent;
+
+        int key = lutKey(color);
+        if ( ambiguous.testBit(key) )
+        {
+            auto it = exact.find(color | 0xff000000);
+            if ( it != exact.end() )
+                return *it;
+        }
+        return lut[key];
+    }
+
+    /**
+     * \brief Converts \p image to Format_Indexed8 using the color table
+     */
+    QImage quantize(const QImage& image, Dither dither = Dither::FloydSteinberg) const;
+
+private:
+    static int lutKey(QRgb color)
+    {
+        return ((qRed(color) >> 3) << 10) | ((qGreen(color) >> 3) << 5) | (qBlue(color) >> 3);
+    }
+
+    /**
+     * \brief Closest entry ignoring the lookup table
+     */
+    int closest(int red, int green, int blue) const;
+
+    /**
+     * \brief Maps the rows in [\p begin, \p end) without error diffusion
+     */
+    void quantizeRows(const QImage& source, uchar* dest, int bytes_per_line,
+                      int begin, int end, Dither dither) const;
+
+    /**
+     * \brief Maps the image with Floyd-Steinberg error diffusion
+     */
+    void diffuse(const QImage& source, uchar* dest, int bytes_per_line) const;
+
+    QVector<QRgb> table;
+    QVector<uchar> lut;
+    QBitArray ambiguous;        ///< Lookup table cells containing an entry
+    QHash<QRgb, int> exact;     ///< Opaque color -> table entry
+    int transparent = -1;       ///< Entry used for transparent pixels
+};
+
+} // namespace misc
+#endif // PIXEL_CAYMAN_MISC_QUANTIZER_HPP
@@ -0,0 +1,211 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rect_packer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <QtConcurrent>
+#include <QtMath>
+
+namespace misc {
+
+RectPacker::RectPacker(const QSize& bin_size)
+    : free_rects{QRect(QPoint(0, 0), bin_size)}, used(0, 0)
+{
+}
+
+QRect RectPacker::insert(const QSize& size)
+{
+    int best = -1;
+    int best_short = std::numeric_limits<int>::max();
+    int best_long = std::numeric_limits<int>::max();
+
+    for ( int i = 0; i < free_rects.size(); i++ )
+    {
+        const QRect& space = free_rects[i];
+        if ( space.width() < size.width() || space.height() < size.height() )
+            continue;
+
+        int leftover_x = space.width() - size.width();
+        int leftover_y = space.height() - size.height();
+        int short_side = qMin(leftover_x, leftover_y);
+        int long_side = qMax(leftover_x, leftover_y);
+        if ( short_side < best_short || (short_side == best_short && long_side < best_long) )
+        {
+            best = i;
+            best_short = short_side;
+            best_long = long_side;
+        }
+    }
+
+    if ( best == -1 )
+        return QRect();
+
+    QRect rect(free_rects[best].topLeft(), size);
+    place(rect);
+    used = used.expandedTo(QSize(rect.right() + 1, rect.bottom() + 1));
+    return rect;
+}
+
+void RectPacker::place(const QRect& rect)
+{
+    // Split the free rectangles overlapping rect into the maximal
+    // rectangles around it
+    QVector<QRect> split;
+    for ( int i = 0; i < free_rects.size(); )
+    {
+        QRect space = free_rects[i];
+        if ( !space.intersects(rect) )
+        {
+            i++;
+            continue;
+        }
+
+        free_rects.remove(i);
+        if ( rect.left() > space.left() )
+            split.push_back(QRect(space.left(), space.top(), rect.left() - space.left(), space.height()));
+        if ( rect.right() < space.right() )
+            split.push_back(QRect(rect.right() + 1, space.top(), space.right() - rect.right(), space.height()));
+        if ( rect.top() > space.top() )
+            split.push_back(QRect(space.left(), space.top(), space.width(), rect.top() - space.top()));
+        if ( rect.bottom() < space.bottom() )
+            split.push_back(QRect(space.left(), rect.bottom() + 1, space.width(), space.bottom() - rect.bottom()));
+    }
+
+    // Only the new rectangles can be redundant
+    for ( int i = 0; i < split.size(); i++ )
+    {
+        bool contained = false;
+        for ( const QRect& space : free_rects )
+            if ( (contained = space.contains(split[i])) )
+                break;
+        for ( int j = 0; j < split.size() && !contained; j++ )
+            if ( i != j && split[j].contains(split[i]) && (split[j] != split[i] || j < i) )
+                contained = true;
+        if ( !contained )
+            free_rects.push_back(split[i]);
+    }
+}
+
+QVector<QRect> RectPacker::pack(const QVector<QSize>& sizes, int max_width, QSize& bin_size)
+{
+    bin_size = QSize(0, 0);
+    if ( sizes.isEmpty() )
+        return {};
+
+    // Larger rectangles first
+    QVector<int> order(sizes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sizes](int a, int b) {
+        int side_a = qMax(sizes[a].width(), sizes[a].height());
+        int side_b = qMax(sizes[b].width(), sizes[b].height());
+        return side_a > side_b;
+    });
+
+    int min_width = 0;
+    qint64 area = 0;
+    int total_height = 0;
+    for ( const QSize& size : sizes )
+    {
+        min_width = qMax(min_width, size.width());
+        area += qint64(size.width()) * size.height();
+        total_height += size.height();
+    }
+    if ( min_width > max_width )
+        return {};
+
+    struct Attempt
+    {
+        int width;
+        QVector<QRect> rects;
+        QSize used;
+    };
+
+    // Candidate widths: the widest rectangle, the side of a square
+    // holding all of them and the powers of two in between
+    QVector<Attempt> attempts;
+    auto add_width = [&attempts, min_width, max_width](int width) {
+        width = qBound(min_width, width, max_width);
+        for ( const Attempt& attempt : attempts )
+            if ( attempt.width == width )
+                return;
+        attempts.push_back({width, {}, QSize()});
+    };
+    add_width(min_width);
+    add_width(qCeil(std::sqrt(double(area))));
+    // Stops before doubling could overflow
+    for ( int width = 16; width < max_width; width *= 2 )
+    {
+        if ( width > min_width )
+            add_width(width);
+        if ( width > max_width / 2 )
+            break;
+    }
+    add_width(max_width);
+
+    QtConcurrent::blockingMap(attempts, [&sizes, &order, total_height](Attempt& attempt) {
+        // Tall enough to always fit, the actual height is what gets used
+        RectPacker packer(QSize(attempt.width, total_height));
+        attempt.rects.resize(sizes.size());
+        attempt.used = QSize();
+        for ( int index : order )
+        {
+            attempt.rects[index] = packer.insert(sizes[index]);
+            if ( attempt.rects[index].isNull() )
+                return;
+        }
+        attempt.used = packer.usedSize();
+    });
+
+    const Attempt* best = nullptr;
+    for ( const Attempt& attempt : attempts )
+    {
+        if ( !attempt.used.isValid() )
+            continue;
+
+        qint64 attempt_area = qint64(attempt.used.width()) * attempt.used.height();
+        if ( !best )
+        {
+            best = &attempt;
+            continue;
+        }
+
+        // Prefer smaller and then squarer results
+        qint64 best_area = qint64(best->used.width()) * best->used.height();
+        if ( attempt_area < best_area ||
+             (attempt_area == best_area &&
+              qAbs(attempt.used.width() - attempt.used.height()) <
+              qAbs(best->used.width() - best->used.height())) )
+            best = &attempt;
+    }
+
+    if ( !best )
+        return {};
+
+    bin_size = best->used;
+    return best->rects;
+}
+
+} // namespace misc
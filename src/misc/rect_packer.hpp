@@ -0,0 +1,73 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_MISC_RECT_PACKER_HPP
+#define PIXEL_CAYMAN_MISC_RECT_PACKER_HPP
+
+#include <QRect>
+#include <QVector>
+
+namespace misc {
+
+/**
+ * \brief Places rectangles in a bin without overlapping
+ *
+ * Uses the MaxRects algorithm: it keeps the list of maximal free
+ * rectangles and puts each new rectangle in the free one which
+ * leaves the shortest side (best short side fit).
+ */
+class RectPacker
+{
+public:
+    explicit RectPacker(const QSize& bin_size);
+
+    /**
+     * \brief Finds a place for a rectangle of the given size
+     * \returns The placed rectangle or a null rect if it doesn't fit
+     */
+    QRect insert(const QSize& size);
+
+    /**
+     * \brief Size of the area containing all the inserted rectangles
+     */
+    QSize usedSize() const
+    {
+        return used;
+    }
+
+    /**
+     * \brief Packs \p sizes in a bin at most \p max_width wide
+     *
+     * Tries multiple widths in parallel and keeps the one with the smallest area.
+     * \param[out] bin_size Size of the area used by the result
+     * \returns The rectangles in the same order as \p sizes,
+     *          empty if some of them are wider than \p max_width
+     */
+    static QVector<QRect> pack(const QVector<QSize>& sizes, int max_width, QSize& bin_size);
+
+private:
+    void place(const QRect& rect);
+
+    QVector<QRect> free_rects;
+    QSize used;
+};
+
+} // namespace misc
+#endif // PIXEL_CAYMAN_MISC_RECT_PACKER_HPP
@@ -0,0 +1,87 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "shared_images.hpp"
+
+#include <cstring>
+
+namespace misc {
+
+quint64 imageHash(const QImage& image)
+{
+    // FNV-1a on 8 bytes at a time, padding at the end of the lines
+    // is skipped as it might not be initialized
+    const quint64 prime = 1099511628211ull;
+    quint64 hash = 14695981039346656037ull;
+    auto feed = [&hash, prime](const uchar* data, int size) {
+        int i = 0;
+        for ( ; i + 8 <= size; i += 8 )
+        {
+            quint64 word;
+            std::memcpy(&word, data + i, 8);
+            hash ^= word;
+            hash *= prime;
+        }
+        for ( ; i < size; i++ )
+        {
+            hash ^= data[i];
+            hash *= prime;
+        }
+    };
+
+    qint32 header[3] = { image.width(), image.height(), qint32(image.format()) };
+    feed(reinterpret_cast<const uchar*>(header), sizeof(header));
+
+    QVector<QRgb> colors = image.colorTable();
+    feed(reinterpret_cast<const uchar*>(colors.constData()), colors.size() * sizeof(QRgb));
+
+    int line_size = (image.width() * image.depth() + 7) / 8;
+    for ( int y = 0; y < image.height(); y++ )
+        feed(image.constScanLine(y), line_size);
+
+    return hash;
+}
+
+int SharedImages::add(const QImage& image)
+{
+    auto key = by_key.find(image.cacheKey());
+    if ( key != by_key.end() )
+        return *key;
+
+    quint64 hash = imageHash(image);
+    for ( auto iter = by_hash.find(hash); iter != by_hash.end() && iter.key() == hash; ++iter )
+    {
+        if ( images[*iter] == image )
+        {
+            by_key.insert(image.cacheKey(), *iter);
+            return *iter;
+        }
+    }
+
+    int index = images.size();
+    images.push_back(image);
+    by_key.insert(image.cacheKey(), index);
+    by_hash.insert(hash, index);
+    return index;
+}
+
+} // namespace misc
@@ -0,0 +1,72 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_MISC_SHARED_IMAGES_HPP
+#define PIXEL_CAYMAN_MISC_SHARED_IMAGES_HPP
+
+#include <QHash>
+#include <QImage>
+#include <QVector>
+
+namespace misc {
+
+/**
+ * \brief Hash of the format, size, color table and pixels of \p image
+ */
+quint64 imageHash(const QImage& image);
+
+/**
+ * \brief Groups images with identical contents
+ *
+ * Images sharing the same buffer are matched by their cache key,
+ * the others by imageHash() and then compared in full.
+ */
+class SharedImages
+{
+public:
+    /**
+     * \brief Returns the index of the image identical to \p image,
+     *        adding it if it hasn't been seen before
+     *
+     * Indices are assigned in order, so a new image gets count() - 1
+     */
+    int add(const QImage& image);
+
+    /**
+     * \brief Number of distinct images
+     */
+    int count() const
+    {
+        return images.size();
+    }
+
+    const QImage& image(int index) const
+    {
+        return images[index];
+    }
+
+private:
+    QVector<QImage> images;
+    QHash<qint64, int> by_key;
+    QMultiHash<quint64, int> by_hash;
+};
+
+} // namespace misc
+#endif // PIXEL_CAYMAN_MISC_SHARED_IMAGES_HPP
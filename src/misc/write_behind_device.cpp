@@ -0,0 +1,153 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "write_behind_device.hpp"
+
+#include <QFileDevice>
+
+namespace misc {
+
+WriteBehindDevice::WriteBehindDevice(QIODevice* target, qint64 block_size, int max_blocks)
+    : target_(target),
+      block_size(qMax<qint64>(block_size, 1)),
+      max_blocks(qMax(max_blocks, 1)),
+      worker(this)
+{
+    current.reserve(this->block_size);
+    QIODevice::open(QIODevice::WriteOnly);
+    worker.start();
+}
+
+WriteBehindDevice::~WriteBehindDevice()
+{
+    close();
+}
+
+void WriteBehindDevice::close()
+{
+    if ( !isOpen() )
+        return;
+
+    if ( !current.isEmpty() )
+        enqueue();
+
+    {
+        QMutexLocker lock(&mutex);
+        finished = true;
+        not_empty.wakeOne();
+    }
+    worker.wait();
+
+    if ( failed() )
+        setErrorString(error);
+
+    QIODevice::close();
+}
+
+bool WriteBehindDevice::failed() const
+{
+    QMutexLocker lock(&mutex);
+    return !error.isEmpty();
+}
+
+qint64 WriteBehindDevice::readData(char*, qint64)
+{
+    return -1;
+}
+
+qint64 WriteBehindDevice::writeData(const char* data, qint64 len)
+{
+    qint64 written = 0;
+    while ( written < len )
+    {
+        if ( failed() )
+        {
+            setErrorString(error);
+            return -1;
+        }
+
+        qint64 chunk = qMin(len - written, block_size - current.size());
+        current.append(data + written, chunk);
+        written += chunk;
+
+        if ( current.size() >= block_size )
+            enqueue();
+    }
+    return written;
+}
+
+void WriteBehindDevice::enqueue()
+{
+    QMutexLocker lock(&mutex);
+    while ( queue.size() >= max_blocks && error.isEmpty() )
+        not_full.wait(&mutex);
+
+    // After an error there's no point in keeping the data around
+    if ( error.isEmpty() )
+    {
+        queue.enqueue(current);
+        not_empty.wakeOne();
+    }
+
+    current = QByteArray();
+    current.reserve(block_size);
+}
+
+void WriteBehindDevice::drain()
+{
+    while ( true )
+    {
+        QByteArray block;
+        {
+            QMutexLocker lock(&mutex);
+            while ( queue.isEmpty() && !finished )
+                not_empty.wait(&mutex);
+            if ( queue.isEmpty() )
+                break;
+            block = queue.dequeue();
+            not_full.wakeOne();
+        }
+
+        if ( target_->write(block) != block.size() )
+        {
+            QMutexLocker lock(&mutex);
+            error = target_->errorString();
+            if ( error.isEmpty() )
+                error = tr("Unknown error");
+            queue.clear();
+            not_full.wakeAll();
+            return;
+        }
+    }
+
+    // Files have their own buffer, flush it here rather than on close
+    if ( QFileDevice* file = qobject_cast<QFileDevice*>(target_) )
+    {
+        if ( !file->flush() )
+        {
+            QMutexLocker lock(&mutex);
+            error = file->errorString();
+        }
+    }
+}
+
+} // namespace misc
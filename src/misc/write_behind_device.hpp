@@ -0,0 +1,143 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_MISC_WRITE_BEHIND_DEVICE_HPP
+#define PIXEL_CAYMAN_MISC_WRITE_BEHIND_DEVICE_HPP
+
+#include <QIODevice>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+namespace misc {
+
+/**
+ * \brief Sequential output device which buffers the data written to it
+ *        and forwards it to another device from a background thread
+ *
+ * The data is collected in blocks of blockSize() bytes, at most maxBlocks()
+ * blocks are kept in memory, after that writes block until the background
+ * thread catches up.
+ *
+ * If \p target is a file, it is also flushed by the background thread.
+ *
+ * Errors from the target device are reported by write() once the background
+ * thread has encountered them, call close() to flush all the pending data
+ * and check failed() to know whether everything has been written.
+ */
+class WriteBehindDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    /**
+     * \brief Opens the device for writing to \p target
+     * \param target     Device receiving the data, must be open for writing
+     *                   and is accessed only by the background thread
+     *                   until close() returns
+     * \param block_size Number of bytes passed to each write on \p target
+     * \param max_blocks Maximum number of blocks waiting to be written
+     */
+    explicit WriteBehindDevice(QIODevice* target,
+                               qint64 block_size = 1 << 20,
+                               int max_blocks = 8);
+    ~WriteBehindDevice();
+
+    bool isSequential() const override { return true; }
+
+    /**
+     * \brief Writes all the pending data to the target and stops the
+     *        background thread
+     */
+    void close() override;
+
+    /**
+     * \brief Device receiving the data
+     */
+    QIODevice* target() const
+    {
+        return target_;
+    }
+
+    qint64 blockSize() const
+    {
+        return block_size;
+    }
+
+    int maxBlocks() const
+    {
+        return max_blocks;
+    }
+
+    /**
+     * \brief Whether writing to the target device has failed
+     *
+     * If so, errorString() contains the error of the target device
+     */
+    bool failed() const;
+
+protected:
+    qint64 readData(char* data, qint64 maxlen) override;
+    qint64 writeData(const char* data, qint64 len) override;
+
+private:
+    class Worker : public QThread
+    {
+    public:
+        explicit Worker(WriteBehindDevice* device) : device(device) {}
+
+    protected:
+        void run() override
+        {
+            device->drain();
+        }
+
+    private:
+        WriteBehindDevice* device;
+    };
+
+    /**
+     * \brief Queues the current block, waiting if too many are pending
+     */
+    void enqueue();
+
+    /**
+     * \brief Writes queued blocks until close() (run in the worker thread)
+     */
+    void drain();
+
+    QIODevice* target_;
+    qint64 block_size;
+    int max_blocks;
+    QByteArray current;
+
+    mutable QMutex mutex;
+    QWaitCondition not_empty;
+    QWaitCondition not_full;
+    QQueue<QByteArray> queue;
+    bool finished = false;
+    QString error;
+
+    Worker worker;
+};
+
+} // namespace misc
+#endif // PIXEL_CAYMAN_MISC_WRITE_BEHIND_DEVICE_HPP
@@ -22,8 +22,78 @@
 
 #include "library_plugin.hpp"
 
+#include <QCryptographicHash>
+#include <QDateTime>
+
+#include "cayman/settings.hpp"
+
 namespace plugin {
 
+namespace {
+
+/**
+ * \brief Settings group holding the metadata of \p file
+ */
+QString metadataKey(const QFileInfo& file)
+{
+    QByteArray hash = QCryptographicHash::hash(
+        file.canonicalFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return "plugin_cache/" + QString::fromLatin1(hash.toHex());
+}
+
+/**
+ * \brief Reads the cached metadata for \p file
+ * \return \b false if there is no metadata or the file has changed since
+ */
+bool readMetadata(const QFileInfo& file, PluginMetadata& metadata)
+{
+    QSettings& settings = cayman::settings::Settings::instance().settings();
+    settings.beginGroup(metadataKey(file));
+    bool valid = settings.value("file").toString() == file.canonicalFilePath() &&
+        settings.value("size").toLongLong() == file.size() &&
+        settings.value("modified").toDateTime() == file.lastModified();
+    if ( valid )
+    {
+        metadata.id = settings.value("id").toString();
+        metadata.name = settings.value("name").toString();
+        metadata.version = settings.value("version").toInt();
+        for ( const QString& dep : settings.value("dependencies").toStringList() )
+        {
+            QStringList parts = dep.split(',');
+            if ( parts.size() == 3 )
+                metadata.dependencies.push_back(
+                    Plugin::Dependency(parts[0], parts[1].toInt(), parts[2].toInt()));
+        }
+        valid = !metadata.id.isEmpty();
+    }
+    settings.endGroup();
+    return valid;
+}
+
+/**
+ * \brief Caches the metadata of \p plugin created from \p file
+ */
+void writeMetadata(const QFileInfo& file, Plugin* plugin)
+{
+    QStringList dependencies;
+    for ( const auto& dep : plugin->dependencies() )
+        dependencies << QString("%1,%2,%3").arg(dep.id)
+            .arg(dep.minimum_version).arg(dep.maximum_version);
+
+    QSettings& settings = cayman::settings::Settings::instance().settings();
+    settings.beginGroup(metadataKey(file));
+    settings.setValue("file", file.canonicalFilePath());
+    settings.setValue("size", file.size());
+    settings.setValue("modified", file.lastModified());
+    settings.setValue("id", plugin->id());
+    settings.setValue("name", plugin->name());
+    settings.setValue("version", plugin->version());
+    settings.setValue("dependencies", dependencies);
+    settings.endGroup();
+}
+
+} // namespace
+
 LibraryPluginFactory::LibraryPluginFactory(const QString& init_function)
     : init_function(init_function)
 {}
@@ -36,6 +106,14 @@ bool LibraryPluginFactory::canCreate(const QFileInfo& file) const
 }
 
 Plugin* LibraryPluginFactory::create(const QString& fileName)
+{
+    PluginMetadata metadata;
+    if ( readMetadata(QFileInfo(fileName), metadata) )
+        return new LibraryPluginProxy(this, fileName, metadata);
+    return createFromLibrary(fileName);
+}
+
+Plugin* LibraryPluginFactory::createFromLibrary(const QString& fileName)
 {
     Library* lib = new Library(fileName);
     auto init = lib->resolve<Plugin*()>(init_function);
@@ -65,6 +143,7 @@ Plugin* LibraryPluginFactory::create(const QString& fileName)
         connect(plugin, &QObject::destroyed, [plugin]{
             libraries.remove(plugin);
         });
+        writeMetadata(QFileInfo(fileName), plugin);
         return plugin;
     }
     else
@@ -78,4 +157,65 @@ Plugin* LibraryPluginFactory::create(const QString& fileName)
 
 QMap<const Plugin*, Library*> LibraryPluginFactory::libraries;
 
+LibraryPluginProxy::LibraryPluginProxy(LibraryPluginFactory* factory,
+                                       const QString& file_name,
+                                       const PluginMetadata& metadata)
+    : factory(factory), file_name(file_name), metadata(metadata)
+{}
+
+LibraryPluginProxy::~LibraryPluginProxy()
+{
+    LibraryPluginFactory::libraries.remove(this);
+    delete plugin_;
+}
+
+bool LibraryPluginProxy::onLoad()
+{
+    if ( !plugin_ )
+    {
+        plugin_ = factory->createFromLibrary(file_name);
+        if ( !plugin_ )
+            return false;
+
+        // Plugins look each other up by id, so they must find the library
+        // from the proxy registered in their place
+        LibraryPluginFactory::libraries[this] =
+            LibraryPluginFactory::libraries.value(plugin_);
+    }
+
+    return plugin_->load();
+}
+
+void LibraryPluginProxy::onUnload()
+{
+    if ( plugin_ )
+        plugin_->unload();
+}
+
+QString LibraryPluginProxy::onId()
+{
+    return metadata.id;
+}
+
+QString LibraryPluginProxy::onName()
+{
+    return plugin_ ? plugin_->name() : metadata.name;
+}
+
+int LibraryPluginProxy::onVersion()
+{
+    return metadata.version;
+}
+
+QList<Plugin::Dependency> LibraryPluginProxy::onDependencies()
+{
+    return metadata.dependencies;
+}
+
+void LibraryPluginProxy::onRetranslate()
+{
+    if ( plugin_ )
+        plugin_->retranslate();
+}
+
 } // namespace plugin
@@ -92,6 +92,17 @@ private:
     QLibrary lib;
 };
 
+/**
+ * \brief Plugin information which can be read without loading the library
+ */
+struct PluginMetadata
+{
+    QString id;
+    QString name;
+    int version = 0;
+    QList<Plugin::Dependency> dependencies;
+};
+
 class LibraryPluginFactory : public PluginFactory
 {
     Q_OBJECT
@@ -99,8 +110,20 @@ public:
     LibraryPluginFactory(const QString& init_function = "Plugin_init");
 
     bool canCreate(const QFileInfo& file) const override;
+
+    /**
+     * \brief Creates a plugin from a library file
+     *
+     * If the metadata for the file has been cached by a previous run,
+     * the library is loaded only once the plugin itself is loaded.
+     */
     Plugin* create(const QString& fileName) override;
 
+    /**
+     * \brief Loads the library and creates the plugin object it defines
+     */
+    Plugin* createFromLibrary(const QString& fileName);
+
     static Library* pluginLibrary(const Plugin* plugin)
     {
         return libraries.value(plugin);
@@ -114,6 +137,47 @@ public:
 private:
     QString init_function;
     static QMap<const Plugin*, Library*> libraries;
+
+    friend class LibraryPluginProxy;
+};
+
+/**
+ * \brief Plugin created from cached metadata, which loads the library
+ *        the first time it's loaded
+ */
+class LibraryPluginProxy : public Plugin
+{
+    Q_OBJECT
+
+public:
+    LibraryPluginProxy(LibraryPluginFactory* factory,
+                       const QString& file_name,
+                       const PluginMetadata& metadata);
+    ~LibraryPluginProxy();
+
+    /**
+     * \brief The plugin object from the library,
+     *        \b nullptr if the library hasn't been loaded yet
+     */
+    Plugin* plugin() const
+    {
+        return plugin_;
+    }
+
+protected:
+    bool onLoad() override;
+    void onUnload() override;
+    QString onId() override;
+    QString onName() override;
+    int onVersion() override;
+    QList<Dependency> onDependencies() override;
+    void onRetranslate() override;
+
+private:
+    LibraryPluginFactory* factory;
+    QString file_name;
+    PluginMetadata metadata;
+    Plugin* plugin_ = nullptr;
 };
 
 } // namespace plugin
@@ -191,6 +191,10 @@ void Brush::draw(view::GraphicsWidget* widget)
     misc::draw::line(line, [this, &painter](const QPoint& point){
         painter.drawPath(brush_path.translated(point));
     });
+    painter.end();
+
+    QRect bounds = brush_path.boundingRect().toAlignedRect();
+    image->markDirty(bounds.translated(line.p1()) | bounds.translated(line.p2()));
 }
 
 QString Brush::actionName(view::GraphicsWidget*) const
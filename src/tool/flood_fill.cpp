@@ -87,6 +87,7 @@ void FloodFill::mousePressEvent(const QMouseEvent* event, view::GraphicsWidget*
             painter.setBrush(widget->color());
             painter.drawRects(region.rects());
             painter.end();
+            image->markDirty(region.boundingRect());
             image->endPainting();
         }
     }
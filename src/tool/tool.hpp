@@ -117,8 +117,7 @@ protected:
         if ( !widget->activeLayer() || widget->activeLayer()->locked() )
             return nullptr;
 
-        /// \todo Select the active frame
-        return widget->activeLayer()->frameImage(nullptr);
+        return widget->activeLayer()->frameImage(widget->documentItem()->frame());
     }
 };
 
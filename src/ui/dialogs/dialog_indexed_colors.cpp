@@ -0,0 +1,139 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "dialog_indexed_colors.hpp"
+
+#include <algorithm>
+#include <QEvent>
+#include <QMessageBox>
+#include <QtConcurrent>
+#include "document/visitor/gather_palette.hpp"
+#include "misc/color_reducer.hpp"
+
+DialogIndexedColors::DialogIndexedColors(document::Document* document, QWidget* parent)
+    : QDialog(parent), document(document)
+{
+    setupUi(this);
+    progress_bar->hide();
+
+    if ( document && document->palette().count() )
+        palette_model.addPalette(document->palette(), false);
+    palette_widget->setModel(&palette_model);
+    if ( palette_model.count() )
+        palette_widget->setCurrentRow(0);
+
+    button_extract->setEnabled(document);
+    connect(button_extract, &QPushButton::clicked, this, &DialogIndexedColors::extract);
+    connect(&future_watcher, &QFutureWatcher<QVector<QRgb>>::finished,
+            this, &DialogIndexedColors::extractFinished);
+}
+
+DialogIndexedColors::~DialogIndexedColors()
+{
+    cancelled = true;
+    future_watcher.waitForFinished();
+}
+
+void DialogIndexedColors::changeEvent(QEvent* event)
+{
+    if ( event->type() == QEvent::LanguageChange )
+    {
+        retranslateUi(this);
+        if ( future_watcher.isRunning() )
+            button_extract->setText(tr("Cancel"));
+    }
+
+    QDialog::changeEvent(event);
+}
+
+void DialogIndexedColors::extract()
+{
+    if ( future_watcher.isRunning() )
+    {
+        cancelled = true;
+        return;
+    }
+
+    // Lazy images must be loaded from this thread,
+    // the histogram is computed along with the reduction
+    document::visitor::LoadImages loader;
+    document->apply(loader);
+    document::visitor::CollectImages collect;
+    document->apply(collect);
+    QList<QImage> images;
+    for ( auto image : collect.images )
+        images.push_back(image->image());
+
+    misc::ColorReducer reducer(
+        misc::ColorReducer::Algorithm(combo_algorithm->currentIndex()),
+        spin_colors->value()
+    );
+
+    cancelled = false;
+    setRunning(true);
+
+    QProgressBar* progress = progress_bar;
+    std::atomic<bool>* cancel = &cancelled;
+    future_watcher.setFuture(QtConcurrent::run([reducer, images, progress, cancel]() -> QVector<QRgb> {
+        misc::ColorHistogram histogram = document::visitor::GatherPalette::gather(images);
+        if ( *cancel )
+            return {};
+        return reducer.reduce(histogram, [progress, cancel](int percent) {
+            QMetaObject::invokeMethod(progress, "setValue",
+                Qt::QueuedConnection, Q_ARG(int, percent));
+            return !*cancel;
+        });
+    }));
+}
+
+void DialogIndexedColors::extractFinished()
+{
+    setRunning(false);
+
+    if ( cancelled )
+        return;
+
+    // Fully transparent pixels only result in the transparent entry
+    QVector<QRgb> colors = future_watcher.result();
+    if ( std::none_of(colors.begin(), colors.end(), [](QRgb color) { return qAlpha(color) != 0; }) )
+    {
+        QMessageBox::information(this, windowTitle(),
+            tr("The image has no opaque colors to build a palette from"));
+        return;
+    }
+
+    color_widgets::ColorPalette palette = color_widgets::ColorPalette::fromColorTable(colors);
+    palette.setName(tr("%1 (%2 colors)")
+        .arg(combo_algorithm->currentText()).arg(colors.size()));
+    palette_model.addPalette(palette, false);
+    palette_widget->setCurrentRow(palette_model.count() - 1);
+}
+
+void DialogIndexedColors::setRunning(bool running)
+{
+    progress_bar->setValue(0);
+    progress_bar->setVisible(running);
+    combo_algorithm->setEnabled(!running);
+    spin_colors->setEnabled(!running);
+    buttonBox->setEnabled(!running);
+    button_extract->setText(running ? tr("Cancel") : tr("Extract From Image"));
+}
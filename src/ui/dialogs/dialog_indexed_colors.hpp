@@ -21,24 +21,27 @@
 #ifndef PIXEL_CAYMAN_DIALOG_INDEXED_COLORS_HPP
 #define PIXEL_CAYMAN_DIALOG_INDEXED_COLORS_HPP
 
+#include <atomic>
 #include <QDialog>
-#include <QEvent>
+#include <QFutureWatcher>
 #include "ui_dialog_indexed_colors.h"
+#include "color_palette_model.hpp"
+#include "document/document.hpp"
 
+/**
+ * \brief Dialog used to select the palette of a document
+ *        when switching to indexed colors
+ *
+ * Palettes can be generated from the colors used in the document,
+ * the reduction runs in a background thread and can be cancelled.
+ */
 class DialogIndexedColors : public QDialog, private Ui::DialogIndexedColors
 {
     Q_OBJECT
 
 public:
-    explicit DialogIndexedColors(QWidget* parent = nullptr)
-    : QDialog(parent)
-    {
-        setupUi(this);
-        /// \todo use a proxy model to display the palettes
-        /// Passed in ctor is a color palette model
-        /// then it provides an optional extra palette for the current document
-        /// modifying this palette shall not edit the document directly
-    }
+    explicit DialogIndexedColors(document::Document* document, QWidget* parent = nullptr);
+    ~DialogIndexedColors();
 
     const color_widgets::ColorPalette& palette() const
     {
@@ -46,15 +49,26 @@ public:
     }
 
 protected:
-    void changeEvent(QEvent* event) override
-    {
-        if ( event->type() == QEvent::LanguageChange )
-        {
-            retranslateUi(this);
-        }
+    void changeEvent(QEvent* event) override;
 
-        QDialog::changeEvent(event);
-    }
+private slots:
+    /**
+     * \brief Starts generating a palette or cancels the running operation
+     */
+    void extract();
+
+    /**
+     * \brief Called when the background reduction has completed
+     */
+    void extractFinished();
+
+private:
+    void setRunning(bool running);
+
+    document::Document* document;
+    color_widgets::ColorPaletteModel palette_model;
+    QFutureWatcher<QVector<QRgb>> future_watcher;
+    std::atomic<bool> cancelled{false};
 };
 
 #endif // PIXEL_CAYMAN_DIALOG_INDEXED_COLORS_HPP
@@ -61,6 +61,13 @@ MainWindow::MainWindow(QWidget* parent)
     /// \todo Dynamic registration/unregistration facilities
     for ( auto tool : ::tool::Registry::instance().tools() )
         addTool(tool);
+
+    for ( auto doc : io::Autosave::recover() )
+    {
+        p->addDocument(doc, true);
+        cayman::Message(Msg::Stream)
+            << tr("Recovered %1").arg(p->documentName(doc));
+    }
 }
 
 MainWindow::~MainWindow()
@@ -166,7 +173,17 @@ bool MainWindow::save(int tab, bool prompt)
     if ( !doc )
         return false;
 
-    if ( doc->fileName().isEmpty() )
+    // Load all the images first (in parallel), so pixels that can't be
+    // decoded are found before anything is written
+    document::visitor::LoadImages loader;
+    doc->apply(loader);
+
+    auto overwrites_damaged = [doc]{
+        return !doc->damagedFile().isEmpty() &&
+            QFileInfo(doc->fileName()) == QFileInfo(doc->damagedFile());
+    };
+
+    if ( doc->fileName().isEmpty() || overwrites_damaged() )
         prompt = true;
 
     auto action = io::Formats::Action::Save;
@@ -222,6 +239,14 @@ bool MainWindow::save(int tab, bool prompt)
         p->main_tab->setTabText(tab, p->documentName(doc));
     }
 
+    if ( overwrites_damaged() )
+    {
+        cayman::Message(Msg::Dialog|Msg::Error)
+            << tr("Some images in %1 could not be loaded, save to a different file to keep the original")
+               .arg(doc->fileName());
+        return false;
+    }
+
     if ( format->save(doc) )
     {
         doc->undoStack().setClean();
@@ -298,6 +323,7 @@ bool MainWindow::closeTab(int tab, bool prompt)
     }
     
     p->undo_group.removeStack(&widget->document()->undoStack());
+    p->autosave.removeDocument(widget->document());
     delete widget->document();
     delete widget;
 
@@ -42,6 +42,7 @@
 #include "dialog_resize_canvas.hpp"
 #include "dialog_settings.hpp"
 #include "document/visitor/resize_canvas.hpp"
+#include "io/autosave.hpp"
 #include "item/layer_tree.hpp"
 #include "labeled_spinbox.hpp"
 #include "log_view.hpp"
@@ -50,8 +51,11 @@
 #include "style/dockwidget_style_icon.hpp"
 #include "tool/tool.hpp"
 #include "ui/menu.hpp"
+#include "ui/palette_loader.hpp"
+#include "ui/widgets/animation_widget.hpp"
 #include "ui/widgets/color_editor.hpp"
 #include "ui/widgets/layer_widget.hpp"
+#include "ui/widgets/navigator_widget.hpp"
 #include "ui/dialogs/dialog_indexed_colors.hpp"
 #include "view/graphics_widget.hpp"
 
@@ -148,6 +152,8 @@ public:
 
     QUndoGroup undo_group;
 
+    io::Autosave autosave;
+
     MainWindow* parent;
 
     bool confirm_close = true;
@@ -159,6 +165,7 @@ public:
     QDockWidget* dock_current_color;
 
     color_widgets::ColorPaletteModel palette_model;
+    PaletteLoader palette_loader{&palette_model};
     color_widgets::ColorPaletteWidget* palette_widget;
     color_widgets::ColorPaletteWidget* palette_editor;
     QDockWidget* dock_palette;
@@ -171,6 +178,12 @@ public:
 
     QDockWidget* dock_tool_options;
 
+    QDockWidget* dock_navigator;
+    NavigatorWidget* navigator;
+
+    QDockWidget* dock_animation;
+    AnimationWidget* animation_widget;
+
     QDockWidget* dock_log;
     LogView*     log_view;
     QMetaObject::Connection log_view_connection;
@@ -180,6 +193,7 @@ public:
     QActionGroup* group_action_color;
     QAction* action_color_rgba;
     QAction* action_color_indexed;
+    QAction* action_palette_lock;
 
     QStringList recent_files;
     int         recent_files_max = 0;
@@ -267,6 +281,14 @@ void MainWindow::Private::initDocks()
     // Tool Options
     dock_tool_options = createDock(nullptr, "preferences-other", "dock_tool_options");
 
+    // Navigator
+    navigator = new NavigatorWidget;
+    dock_navigator = createDock(navigator, "zoom-fit-best", "dock_navigator");
+
+    // Animation
+    animation_widget = new AnimationWidget;
+    dock_animation = createDock(animation_widget, "media-playback-start", "dock_animation");
+
     // Log view
     log_view = new LogView;
     log_view->setStderrColor(Qt::darkRed);
@@ -290,6 +312,10 @@ void MainWindow::Private::initDocks()
     parent->tabifyDockWidget(dock_tool_options, dock_set_color);
     dock_tool_options->raise();
     // right
+    parent->addDockWidget(Qt::RightDockWidgetArea, dock_navigator);
+    parent->addDockWidget(Qt::RightDockWidgetArea, dock_animation);
+    parent->tabifyDockWidget(dock_navigator, dock_animation);
+    dock_navigator->raise();
     parent->addDockWidget(Qt::RightDockWidgetArea, dock_layers);
     parent->addDockWidget(Qt::RightDockWidgetArea, dock_palette);
     parent->addDockWidget(Qt::RightDockWidgetArea, dock_palette_editor);
@@ -310,6 +336,8 @@ void MainWindow::Private::initDocks()
         dock_undo_history,
         dock_layers,
         dock_tool_options,
+        dock_navigator,
+        dock_animation,
     });
 }
 
@@ -322,6 +350,8 @@ void MainWindow::Private::translateDocks()
     dock_undo_history->setWindowTitle(tr("Action History"));
     dock_tool_options->setWindowTitle(tr("Tool Options"));
     dock_layers->setWindowTitle(tr("Layers"));
+    dock_navigator->setWindowTitle(tr("Navigator"));
+    dock_animation->setWindowTitle(tr("Animation"));
     dock_log->setWindowTitle(tr("Log"));
 }
 
@@ -379,13 +409,20 @@ void MainWindow::Private::initMenus()
             return;
         }
 
-        DialogIndexedColors dlg(parent);
+        DialogIndexedColors dlg(current_view->document(), parent);
         if ( dlg.exec() )
         {
             current_view->document()->setPalette(dlg.palette());
             current_view->document()->setIndexedColors(true);
         }
-        /// \todo Show dialog
+    });
+    menu_color->addSeparator();
+    action_palette_lock = new QAction(parent);
+    action_palette_lock->setCheckable(true);
+    menu_color->addAction(action_palette_lock);
+    connect(action_palette_lock, &QAction::triggered, [this](bool on){
+        if ( current_view )
+            current_view->document()->setPaletteLocked(on);
     });
 
     // Plugins
@@ -441,6 +478,8 @@ void MainWindow::Private::translateMenus()
 {
     action_color_rgba->setText(tr("Full &Color"));
     action_color_indexed->setText(tr("&Indexed"));
+    action_palette_lock->setText(tr("&Lock Palette Colors"));
+    action_palette_lock->setToolTip(tr("Editing a palette color also recolors the pixels using it"));
 }
 
 
@@ -489,11 +528,12 @@ void MainWindow::Private::loadSettings(bool window_state)
     palette_model.addSearchPath("/usr/share/gimp/2.0/palettes/");
     palette_model.addSearchPath("/usr/share/inkscape/palettes/");
     palette_model.addSearchPath("/usr/share/kde4/apps/calligra/palettes/");
-    palette_model.load();
+    palette_loader.load();
 
     recent_files_max = cayman::settings::get("file/recent_max", 16);
     recent_files = cayman::settings::get("file/recent", QStringList{});
     confirm_close = cayman::settings::get("file/confirm_close", confirm_close);
+    autosave.setInterval(cayman::settings::get("file/autosave_interval", 60));
 
     if ( !recent_files.empty() )
     {
@@ -608,6 +648,7 @@ int MainWindow::Private::addDocument(document::Document* doc, bool set_current)
     view::GraphicsWidget* widget = new view::GraphicsWidget(doc);
 
     undo_group.addStack(&doc->undoStack());
+    autosave.addDocument(doc);
 
     int tab = main_tab->addTab(widget, documentName(doc));
     connect(&doc->undoStack(), &QUndoStack::cleanChanged,
@@ -620,6 +661,12 @@ int MainWindow::Private::addDocument(document::Document* doc, bool set_current)
         if ( widget == current_view )
             updateTitle();
     });
+    connect(doc, &document::Document::loadFailed, [](const QString& file_name)
+    {
+        cayman::Message(Msg::AllOutput|Msg::Error)
+            << tr("Some images in %1 could not be loaded and have been left transparent")
+               .arg(file_name);
+    });
 
     if ( set_current )
         main_tab->setCurrentIndex(tab);
@@ -644,6 +691,7 @@ void MainWindow::Private::setCurrentView(view::GraphicsWidget* widget)
         plugin::api().setCurrentDocument(nullptr);
         for ( QAction* action : group_action_color->actions() )
             action->setChecked(false);
+        action_palette_lock->setChecked(false);
     }
 
     current_view = widget;
@@ -656,6 +704,8 @@ void MainWindow::Private::setCurrentView(view::GraphicsWidget* widget)
         Private::linkColor(widget, current_color_selector.color);
         document->undoStack().setActive(true);
         layer_widget->setDocument(document);
+        navigator->setView(widget);
+        animation_widget->setView(widget);
         connect(layer_widget, &LayerWidget::activeLayerChanged,
                 widget, &view::GraphicsWidget::setActiveLayer);
         connect(widget, &view::GraphicsWidget::activeLayerChanged,
@@ -665,6 +715,7 @@ void MainWindow::Private::setCurrentView(view::GraphicsWidget* widget)
             action_color_indexed->setChecked(true);
         else
             action_color_rgba->setChecked(true);
+        action_palette_lock->setChecked(document->paletteLocked());
 
         auto set_zoom = [this, widget](qreal factor) {
             if ( widget == current_view )
@@ -681,6 +732,8 @@ void MainWindow::Private::setCurrentView(view::GraphicsWidget* widget)
     else
     {
         layer_widget->setDocument(nullptr);
+        navigator->setView(nullptr);
+        animation_widget->setView(nullptr);
     }
 
     bool editors_enabled = widget != nullptr;
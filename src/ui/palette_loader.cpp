@@ -0,0 +1,306 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "palette_loader.hpp"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QSaveFile>
+#include <QtConcurrent>
+
+#include "cayman/data.hpp"
+
+namespace {
+
+const QByteArray cache_magic("CAYMANP\0", 8);
+const quint32 cache_version = 1;
+
+} // namespace
+
+PaletteLoader::PaletteLoader(color_widgets::ColorPaletteModel* model, QObject* parent)
+    : QObject(parent), model(model)
+{
+    connect(&future_watcher, &QFutureWatcher<void>::finished,
+            this, &PaletteLoader::scanFinished);
+
+    // Saving a palette touches both the file and the directory
+    refresh_timer.setSingleShot(true);
+    refresh_timer.setInterval(250);
+    connect(&refresh_timer, &QTimer::timeout, this, &PaletteLoader::refresh);
+    connect(&file_watcher, &QFileSystemWatcher::directoryChanged,
+            &refresh_timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(&file_watcher, &QFileSystemWatcher::fileChanged,
+            &refresh_timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+}
+
+PaletteLoader::~PaletteLoader()
+{
+    cancel();
+}
+
+QString PaletteLoader::cacheFile()
+{
+    return cayman::data().writable("cache/palettes");
+}
+
+void PaletteLoader::load()
+{
+    if ( model->searchPaths() == loaded_paths )
+        return;
+
+    cancel();
+
+    {
+        QMutexLocker lock(&mutex);
+        pending.clear();
+    }
+
+    // ColorPaletteModel::removeRows() would delete the files
+    for ( int i = model->count() - 1; i >= 0; i-- )
+        model->removePalette(i, false);
+
+    if ( !cache_read )
+        readCache();
+
+    loaded_paths = model->searchPaths();
+    start(false);
+}
+
+void PaletteLoader::cancel()
+{
+    refresh_timer.stop();
+    cancelled = true;
+    future_watcher.waitForFinished();
+}
+
+void PaletteLoader::refresh()
+{
+    if ( isLoading() )
+        refresh_timer.start();
+    else
+        start(true);
+}
+
+void PaletteLoader::start(bool incremental)
+{
+    this->incremental = incremental;
+    cancelled = false;
+    {
+        QMutexLocker lock(&mutex);
+        scan_complete = false;
+    }
+    future_watcher.setFuture(QtConcurrent::run(this, &PaletteLoader::scan,
+                                               loaded_paths, cache, incremental));
+}
+
+void PaletteLoader::scan(const QStringList& search_paths, const Cache& cache, bool incremental)
+{
+    Cache found;
+    int parsed_count = 0;
+
+    for ( const QString& directory_name : search_paths )
+    {
+        QDir directory(directory_name);
+        directory.setNameFilters({"*.gpl"});
+        directory.setFilter(QDir::Files|QDir::Readable);
+        directory.setSorting(QDir::Name);
+        for ( const QFileInfo& file : directory.entryInfoList() )
+        {
+            if ( cancelled )
+                return;
+
+            QString path = file.absoluteFilePath();
+            qint64 modified = file.lastModified().toMSecsSinceEpoch();
+            auto cached = cache.find(path);
+            bool changed = cached == cache.end() ||
+                cached->size != file.size() || cached->modified != modified;
+
+            PaletteData data;
+            if ( changed )
+            {
+                color_widgets::ColorPalette palette;
+                if ( !palette.load(path) )
+                    continue;
+                data = {path, file.size(), modified, palette.name(),
+                        palette.columns(), palette.colors()};
+                parsed_count++;
+            }
+            else
+            {
+                data = *cached;
+            }
+            found.insert(path, data);
+
+            if ( !changed && incremental )
+                continue;
+
+            QMutexLocker lock(&mutex);
+            pending.push_back(data);
+            if ( !flush_queued )
+            {
+                flush_queued = true;
+                QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+            }
+        }
+    }
+
+    QMutexLocker lock(&mutex);
+    scanned = found;
+    parsed = parsed_count;
+    scan_complete = true;
+}
+
+void PaletteLoader::flush()
+{
+    QList<PaletteData> palettes;
+    {
+        QMutexLocker lock(&mutex);
+        palettes.swap(pending);
+        flush_queued = false;
+    }
+
+    for ( const PaletteData& data : palettes )
+    {
+        color_widgets::ColorPalette palette(data.name);
+        palette.setColors(data.colors);
+        palette.setColumns(data.columns);
+        palette.setFileName(data.file_name);
+        palette.setDirty(false);
+
+        // After a full load the model is empty, no need to look for the file
+        int index = incremental ? model->indexFromFile(data.file_name) : -1;
+        if ( index != -1 )
+            model->updatePalette(index, palette, false);
+        else
+            model->addPalette(palette, false);
+    }
+}
+
+void PaletteLoader::scanFinished()
+{
+    flush();
+
+    Cache result;
+    int parsed_count;
+    {
+        QMutexLocker lock(&mutex);
+        if ( !scan_complete )
+            return;
+        result.swap(scanned);
+        parsed_count = parsed;
+    }
+
+    if ( incremental )
+    {
+        for ( auto it = cache.begin(); it != cache.end(); ++it )
+        {
+            if ( !result.contains(it.key()) )
+            {
+                int index = model->indexFromFile(it.key());
+                if ( index != -1 )
+                    model->removePalette(index, false);
+            }
+        }
+    }
+
+    bool changed = parsed_count != 0 || result.size() != cache.size();
+    cache = result;
+    if ( changed )
+        writeCache();
+
+    watch();
+    emit finished();
+}
+
+void PaletteLoader::watch()
+{
+    QStringList watched = file_watcher.files() + file_watcher.directories();
+    if ( !watched.isEmpty() )
+        file_watcher.removePaths(watched);
+
+    QStringList paths;
+    for ( const QString& path : loaded_paths )
+        if ( QDir(path).exists() )
+            paths << path;
+    paths += cache.keys();
+    if ( !paths.isEmpty() )
+        file_watcher.addPaths(paths);
+}
+
+void PaletteLoader::readCache()
+{
+    cache_read = true;
+
+    QFile file(cacheFile());
+    if ( !file.open(QIODevice::ReadOnly) )
+        return;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    QByteArray magic(cache_magic.size(), '\0');
+    quint32 version = 0;
+    quint32 count = 0;
+    in.readRawData(magic.data(), magic.size());
+    in >> version >> count;
+    if ( magic != cache_magic || version != cache_version )
+        return;
+
+    for ( quint32 i = 0; i < count; i++ )
+    {
+        PaletteData data;
+        in >> data.file_name >> data.size >> data.modified
+           >> data.name >> data.columns >> data.colors;
+        if ( in.status() != QDataStream::Ok )
+        {
+            cache.clear();
+            return;
+        }
+        cache.insert(data.file_name, data);
+    }
+}
+
+void PaletteLoader::writeCache() const
+{
+    QString file_name = cacheFile();
+    QDir().mkpath(QFileInfo(file_name).path());
+
+    QSaveFile file(file_name);
+    if ( !file.open(QIODevice::WriteOnly) )
+        return;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out.writeRawData(cache_magic.constData(), cache_magic.size());
+    out << cache_version << quint32(cache.size());
+    for ( const PaletteData& data : cache )
+    {
+        out << data.file_name << data.size << data.modified
+            << data.name << data.columns << data.colors;
+    }
+
+    if ( out.status() == QDataStream::Ok )
+        file.commit();
+    else
+        file.cancelWriting();
+}
@@ -0,0 +1,160 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_PALETTE_LOADER_HPP
+#define PIXEL_CAYMAN_PALETTE_LOADER_HPP
+
+#include <atomic>
+
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QMutex>
+#include <QTimer>
+
+#include "color_palette_model.hpp"
+
+/**
+ * \brief Loads the palettes found in the search paths of a ColorPaletteModel
+ *        from a background thread
+ *
+ * Palettes are added to the model as soon as they are available.
+ *
+ * Parsed palettes are stored in a cache file so only the files which have
+ * changed since the previous run are parsed again. Once loaded, the search
+ * paths are watched and the model is updated when palette files are added,
+ * modified or removed.
+ */
+class PaletteLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PaletteLoader(color_widgets::ColorPaletteModel* model,
+                           QObject* parent = nullptr);
+    ~PaletteLoader();
+
+    /**
+     * \brief Whether the search paths are still being scanned
+     */
+    bool isLoading() const
+    {
+        return future_watcher.isRunning();
+    }
+
+    /**
+     * \brief File storing the parsed palettes between runs
+     */
+    static QString cacheFile();
+
+public slots:
+    /**
+     * \brief Replaces the palettes in the model with the ones in its
+     *        search paths
+     *
+     * Does nothing if the search paths haven't changed since the last call,
+     * as the model is already kept up to date.
+     */
+    void load();
+
+    /**
+     * \brief Stops loading, keeping the palettes loaded so far
+     */
+    void cancel();
+
+signals:
+    /**
+     * \brief Emitted once all the palettes have been added to the model
+     */
+    void finished();
+
+private slots:
+    /**
+     * \brief Moves the palettes parsed by the background thread to the model
+     */
+    void flush();
+
+    /**
+     * \brief Rescans the search paths after a file has changed
+     */
+    void refresh();
+
+    /**
+     * \brief Updates the cache once the background thread is done
+     */
+    void scanFinished();
+
+private:
+    /**
+     * \brief Palette contents, ColorPalette objects can't be shared
+     *        between threads
+     */
+    struct PaletteData
+    {
+        QString file_name;
+        qint64 size;
+        qint64 modified;
+        QString name;
+        qint32 columns;
+        QVector<color_widgets::ColorPalette::value_type> colors;
+    };
+    using Cache = QHash<QString, PaletteData>;
+
+    /**
+     * \brief Starts scanning the search paths
+     * \param incremental Whether only the changes have to be applied to
+     *                    the model
+     */
+    void start(bool incremental);
+
+    /**
+     * \brief Parses the palette files not in \p cache
+     *        (run in a background thread)
+     */
+    void scan(const QStringList& search_paths, const Cache& cache, bool incremental);
+
+    void readCache();
+    void writeCache() const;
+
+    /**
+     * \brief Watches the search paths and the loaded files for changes
+     */
+    void watch();
+
+    color_widgets::ColorPaletteModel* model;
+    QFutureWatcher<void> future_watcher;
+    std::atomic<bool> cancelled{false};
+
+    QMutex mutex;
+    QList<PaletteData> pending;
+    bool flush_queued = false;
+    Cache scanned;
+    int parsed = 0;
+    bool scan_complete = false;
+
+    Cache cache;
+    bool cache_read = false;
+    bool incremental = false;
+    QStringList loaded_paths;
+    QFileSystemWatcher file_watcher;
+    QTimer refresh_timer;
+};
+
+#endif // PIXEL_CAYMAN_PALETTE_LOADER_HPP
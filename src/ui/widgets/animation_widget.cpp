@@ -0,0 +1,313 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "animation_widget.hpp"
+
+#include "document/visitor.hpp"
+#include "misclib/util.hpp"
+
+AnimationWidget::AnimationWidget()
+{
+    setupUi(this);
+
+    connect(combo_animation, util::overload<int>(&QComboBox::currentIndexChanged),
+            this, &AnimationWidget::updateAnimations);
+    connect(spin_frame, util::overload<int>(&QSpinBox::valueChanged),
+            this, &AnimationWidget::selectFrame);
+    connect(button_add_animation, &QAbstractButton::clicked,
+            this, &AnimationWidget::addAnimation);
+    connect(button_add_frame, &QAbstractButton::clicked,
+            this, &AnimationWidget::addFrame);
+    connect(button_remove_frame, &QAbstractButton::clicked,
+            this, &AnimationWidget::removeFrame);
+    connect(button_play, &QAbstractButton::toggled, [this](bool checked){
+        if ( player )
+            player->setPlaying(checked);
+        // Playback doesn't start on empty animations
+        button_play->setChecked(player && player->playing());
+    });
+    connect(button_loop, &QAbstractButton::toggled, [this](bool checked){
+        if ( player )
+            player->setLoop(checked);
+    });
+
+    connect(spin_onion_before, util::overload<int>(&QSpinBox::valueChanged), [this](int count){
+        if ( view_ )
+            view_->documentItem()->setOnionSkinBefore(count);
+    });
+    connect(spin_onion_after, util::overload<int>(&QSpinBox::valueChanged), [this](int count){
+        if ( view_ )
+            view_->documentItem()->setOnionSkinAfter(count);
+    });
+    connect(slider_onion_opacity, &QSlider::valueChanged, [this](int percent){
+        if ( view_ )
+            view_->documentItem()->setOnionSkinOpacity(percent / 100.0);
+    });
+    connect(color_onion_before, &color_widgets::ColorPreview::colorChanged, [this](const QColor& color){
+        if ( view_ )
+            view_->documentItem()->setOnionSkinColorBefore(color);
+    });
+    connect(color_onion_after, &color_widgets::ColorPreview::colorChanged, [this](const QColor& color){
+        if ( view_ )
+            view_->documentItem()->setOnionSkinColorAfter(color);
+    });
+
+    updateAnimations();
+    updateOnionSkin();
+}
+
+void AnimationWidget::changeEvent(QEvent* event)
+{
+    if ( event->type() == QEvent::LanguageChange )
+    {
+        retranslateUi(this);
+    }
+
+    QWidget::changeEvent(event);
+}
+
+void AnimationWidget::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    showImage();
+}
+
+void AnimationWidget::showEvent(QShowEvent* event)
+{
+    QWidget::showEvent(event);
+    if ( player )
+        player->setActive(true);
+}
+
+void AnimationWidget::hideEvent(QHideEvent* event)
+{
+    QWidget::hideEvent(event);
+    // Nothing is previewed while the dock is hidden
+    if ( player )
+        player->setActive(false);
+}
+
+::view::GraphicsWidget* AnimationWidget::view() const
+{
+    return view_;
+}
+
+void AnimationWidget::setView(::view::GraphicsWidget* view)
+{
+    for ( const auto& connection : connections )
+        disconnect(connection);
+    connections.clear();
+
+    delete player;
+    player = nullptr;
+    view_ = view;
+    label_preview->clear();
+
+    if ( view )
+    {
+        player = new ::view::AnimationPlayer(view->document(), this);
+        player->setActive(isVisible());
+        player->setLoop(button_loop->isChecked());
+        connect(player, &::view::AnimationPlayer::imageChanged,
+                this, &AnimationWidget::showImage);
+        connect(player, &::view::AnimationPlayer::playingChanged,
+                button_play, &QAbstractButton::setChecked);
+
+        connections << connect(view->document(), &::document::DocumentElement::edited,
+                               this, &AnimationWidget::updateAnimations);
+        connections << connect(view->documentItem(), &::view::GraphicsItem::frameChanged,
+                               this, &AnimationWidget::updateAnimations);
+        connections << connect(view->documentItem(), &::view::GraphicsItem::onionSkinChanged,
+                               this, &AnimationWidget::updateOnionSkin);
+    }
+
+    updateAnimations();
+    updateOnionSkin();
+}
+
+void AnimationWidget::updateOnionSkin()
+{
+    QList<QWidget*> controls{
+        spin_onion_before, spin_onion_after, slider_onion_opacity,
+        color_onion_before, color_onion_after
+    };
+
+    for ( QWidget* control : controls )
+    {
+        control->setEnabled(!view_.isNull());
+        control->blockSignals(true);
+    }
+
+    if ( view_ )
+    {
+        ::view::GraphicsItem* item = view_->documentItem();
+        spin_onion_before->setValue(item->onionSkinBefore());
+        spin_onion_after->setValue(item->onionSkinAfter());
+        slider_onion_opacity->setValue(qRound(item->onionSkinOpacity() * 100));
+        color_onion_before->setColor(item->onionSkinColorBefore());
+        color_onion_after->setColor(item->onionSkinColorAfter());
+    }
+
+    for ( QWidget* control : controls )
+        control->blockSignals(false);
+}
+
+::document::Animation* AnimationWidget::animation() const
+{
+    return combo_animation->currentData().value< ::document::Animation*>();
+}
+
+void AnimationWidget::updateAnimations()
+{
+    QList< ::document::Animation*> animations;
+    if ( view_ )
+        animations = view_->document()->animations();
+
+    // Animations can be added, removed or renamed by undo commands
+    bool changed = combo_animation->count() != animations.size();
+    for ( int i = 0; !changed && i < animations.size(); i++ )
+        changed = combo_animation->itemData(i).value< ::document::Animation*>() != animations[i] ||
+                  combo_animation->itemText(i) != animations[i]->name();
+
+    if ( changed )
+    {
+        ::document::Animation* current = animation();
+        combo_animation->blockSignals(true);
+        combo_animation->clear();
+        for ( auto anim : animations )
+            combo_animation->addItem(anim->name(), QVariant::fromValue(anim));
+        combo_animation->setCurrentIndex(qMax(0, animations.indexOf(current)));
+        combo_animation->blockSignals(false);
+    }
+
+    ::document::Animation* anim = animation();
+    if ( player && player->animation() != anim )
+        player->setAnimation(anim);
+
+    int number = 0;
+    if ( view_ )
+    {
+        ::view::GraphicsItem* item = view_->documentItem();
+        if ( item->frame() )
+        {
+            number = anim ? anim->frames().indexOf(item->frame()) + 1 : 0;
+            // The frame has been removed or belongs to a different animation
+            if ( number == 0 )
+                item->setFrame(nullptr);
+        }
+    }
+
+    int count = anim ? anim->count() : 0;
+    spin_frame->blockSignals(true);
+    spin_frame->setMaximum(count);
+    spin_frame->setValue(number);
+    spin_frame->blockSignals(false);
+
+    button_add_animation->setEnabled(!view_.isNull());
+    combo_animation->setEnabled(anim != nullptr);
+    spin_frame->setEnabled(anim != nullptr);
+    button_add_frame->setEnabled(anim != nullptr);
+    button_remove_frame->setEnabled(number > 0);
+    button_play->setEnabled(count > 0);
+}
+
+void AnimationWidget::selectFrame(int number)
+{
+    ::document::Animation* anim = animation();
+    if ( !view_ || !anim )
+        return;
+
+    view_->documentItem()->setFrame(number > 0 ? anim->frame(number - 1) : nullptr);
+
+    if ( number > 0 && !player->playing() )
+        player->setFrame(number - 1);
+}
+
+void AnimationWidget::addAnimation()
+{
+    if ( !view_ )
+        return;
+
+    ::document::Document* document = view_->document();
+
+    QString name_template = tr("Animation%1");
+    QString name = name_template.arg("");
+    for ( int i = 1; document->animation(name); i++ )
+        name = name_template.arg(i);
+
+    ::document::Animation* anim = document->addAnimation(name);
+    updateAnimations();
+    combo_animation->setCurrentIndex(combo_animation->findData(QVariant::fromValue(anim)));
+}
+
+void AnimationWidget::addFrame()
+{
+    ::document::Animation* anim = animation();
+    if ( !view_ || !anim )
+        return;
+
+    ::document::Document* document = view_->document();
+    int number = spin_frame->value();
+
+    document->undoStack().beginMacro(tr("Add Frame"));
+    ::document::Frame* frame = anim->createFrame(number, number - 1);
+
+    // Frames added while editing the still image start from a copy of it
+    if ( number == 0 )
+    {
+        ::document::visitor::CollectImages collect;
+        document->apply(collect);
+        for ( ::document::Image* image : collect.images )
+            if ( !image->frame() )
+                image->layer()->insertFrameImage(image->image(), frame);
+    }
+    document->undoStack().endMacro();
+
+    updateAnimations();
+    spin_frame->setValue(anim->frames().indexOf(frame) + 1);
+}
+
+void AnimationWidget::removeFrame()
+{
+    ::document::Animation* anim = animation();
+    int number = spin_frame->value();
+    if ( !view_ || !anim || number <= 0 )
+        return;
+
+    anim->removeFrame(number - 1);
+    updateAnimations();
+    spin_frame->setValue(qMin(number, anim->count()));
+}
+
+void AnimationWidget::showImage()
+{
+    if ( !player )
+        return;
+
+    QImage image = player->image();
+    if ( image.isNull() )
+        return;
+
+    // Nearest neighbour keeps the pixels sharp
+    label_preview->setPixmap(QPixmap::fromImage(image.scaled(
+        label_preview->size(), Qt::KeepAspectRatio, Qt::FastTransformation
+    )));
+}
@@ -0,0 +1,86 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_ANIMATION_WIDGET_HPP
+#define PIXEL_CAYMAN_ANIMATION_WIDGET_HPP
+
+#include <QPointer>
+#include <QWidget>
+#include "ui_animation_widget.h"
+#include "view/animation_player.hpp"
+#include "view/graphics_widget.hpp"
+
+/**
+ * \brief Selects the animation frame edited in a view and plays a preview
+ *        of the animation
+ *
+ * It also controls the onion skins the view shows around the edited frame.
+ */
+class AnimationWidget : public QWidget, private Ui::AnimationWidget
+{
+    Q_OBJECT
+
+    Q_PROPERTY(::view::GraphicsWidget* view READ view WRITE setView)
+
+public:
+    AnimationWidget();
+
+    ::view::GraphicsWidget* view() const;
+
+public slots:
+    void setView(::view::GraphicsWidget* view);
+    void addAnimation();
+    /**
+     * \brief Adds a frame after the current one, copying its images
+     */
+    void addFrame();
+    void removeFrame();
+
+protected:
+    void changeEvent(QEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private slots:
+    /**
+     * \brief Updates the controls after animations or frames are added or removed
+     */
+    void updateAnimations();
+    void selectAnimation(int index);
+    /**
+     * \brief Shows the frame at \p number (1-based, 0 is the still image) in the view
+     */
+    void selectFrame(int number);
+    void showImage();
+    /**
+     * \brief Updates the onion skin controls from the view
+     */
+    void updateOnionSkin();
+
+private:
+    ::document::Animation* animation() const;
+
+    QPointer< ::view::GraphicsWidget> view_;
+    ::view::AnimationPlayer* player = nullptr;
+    QList<QMetaObject::Connection> connections;
+};
+
+#endif // PIXEL_CAYMAN_ANIMATION_WIDGET_HPP
@@ -0,0 +1,191 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "navigator_widget.hpp"
+
+#include <QMouseEvent>
+#include <QPainter>
+
+NavigatorWidget::NavigatorWidget()
+{
+    setMinimumSize(64, 64);
+    setCursor(Qt::PointingHandCursor);
+}
+
+::view::GraphicsWidget* NavigatorWidget::view() const
+{
+    return view_;
+}
+
+QSize NavigatorWidget::sizeHint() const
+{
+    return QSize(200, 150);
+}
+
+void NavigatorWidget::setView(::view::GraphicsWidget* view)
+{
+    for ( const auto& connection : connections )
+        disconnect(connection);
+    connections.clear();
+
+    view_ = view;
+    cache = nullptr;
+
+    if ( view )
+    {
+        cache = ::view::RenderCache::of(view->document());
+        connections << connect(cache, &::view::RenderCache::changed,
+                               this, &NavigatorWidget::imageChanged);
+        connections << connect(view, &::view::GraphicsWidget::viewportChanged,
+                               this, [this]{ update(); });
+    }
+
+    resetThumbnail();
+}
+
+void NavigatorWidget::resetThumbnail()
+{
+    dirty = QRegion();
+
+    if ( !cache )
+    {
+        thumbnail = QImage();
+        image_size = QSize();
+        update();
+        return;
+    }
+
+    image_size = cache->document()->imageSize();
+    if ( image_size.isEmpty() )
+    {
+        thumbnail = QImage();
+        update();
+        return;
+    }
+
+    scale = qMin(qreal(width()) / image_size.width(),
+                 qreal(height()) / image_size.height());
+    QSize size = (QSizeF(image_size) * scale).toSize().expandedTo(QSize(1, 1));
+    if ( thumbnail.size() != size )
+        thumbnail = QImage(size, QImage::Format_ARGB32_Premultiplied);
+    dirty = thumbnail.rect();
+    update();
+}
+
+void NavigatorWidget::imageChanged(const QRect& rect)
+{
+    if ( !cache )
+        return;
+
+    if ( cache->document()->imageSize() != image_size )
+    {
+        resetThumbnail();
+        return;
+    }
+
+    QRectF scaled(rect.x() * scale, rect.y() * scale,
+                  rect.width() * scale, rect.height() * scale);
+    dirty += scaled.toAlignedRect().intersected(thumbnail.rect());
+    update(thumbnailRect());
+}
+
+void NavigatorWidget::flush()
+{
+    if ( !cache || dirty.isEmpty() )
+        return;
+
+    QPainter painter(&thumbnail);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, scale < 1);
+
+    for ( const QRect& rect : dirty.rects() )
+    {
+        QRectF source(rect.x() / scale, rect.y() / scale,
+                      rect.width() / scale, rect.height() / scale);
+        const QImage& flat = cache->image(nullptr, false, source.toAlignedRect());
+        painter.drawImage(QRectF(rect), flat, source);
+    }
+
+    dirty = QRegion();
+}
+
+QRect NavigatorWidget::thumbnailRect() const
+{
+    QRect rect(QPoint(0, 0), thumbnail.size());
+    rect.moveCenter(this->rect().center());
+    return rect;
+}
+
+void NavigatorWidget::paintEvent(QPaintEvent* event)
+{
+    /// \todo Make it available as an object in the color_widgets library
+    static QBrush transparency(QPixmap(QLatin1String(":/color_widgets/alphaback.png")));
+
+    if ( thumbnail.isNull() )
+        return;
+
+    flush();
+
+    QPainter painter(this);
+    QRect target = thumbnailRect();
+    painter.fillRect(target, transparency);
+    painter.drawImage(target.topLeft(), thumbnail);
+
+    if ( view_ )
+    {
+        QRectF visible = view_->visibleImageRect();
+        QRectF frame(target.x() + visible.x() * scale,
+                     target.y() + visible.y() * scale,
+                     visible.width() * scale,
+                     visible.height() * scale);
+        painter.setClipRect(target);
+        painter.setBrush(Qt::NoBrush);
+        painter.setPen(QPen(palette().highlight(), 2));
+        painter.drawRect(frame.adjusted(1, 1, -1, -1));
+    }
+}
+
+void NavigatorWidget::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    resetThumbnail();
+}
+
+void NavigatorWidget::moveView(const QPoint& pos)
+{
+    if ( !view_ || thumbnail.isNull() )
+        return;
+
+    QPointF point = pos - thumbnailRect().topLeft();
+    view_->centerOnImage(point / scale);
+}
+
+void NavigatorWidget::mousePressEvent(QMouseEvent* event)
+{
+    if ( event->button() == Qt::LeftButton )
+        moveView(event->pos());
+}
+
+void NavigatorWidget::mouseMoveEvent(QMouseEvent* event)
+{
+    if ( event->buttons() & Qt::LeftButton )
+        moveView(event->pos());
+}
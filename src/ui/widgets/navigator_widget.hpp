@@ -0,0 +1,85 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_NAVIGATOR_WIDGET_HPP
+#define PIXEL_CAYMAN_NAVIGATOR_WIDGET_HPP
+
+#include <QPointer>
+#include <QWidget>
+#include "view/graphics_widget.hpp"
+
+/**
+ * \brief Shows a scaled down preview of the whole document and the area
+ * visible in a view, clicking on it moves the view
+ *
+ * The preview is kept in a buffer which is only updated in the areas
+ * reported as changed by the document render cache.
+ */
+class NavigatorWidget : public QWidget
+{
+    Q_OBJECT
+
+    Q_PROPERTY(::view::GraphicsWidget* view READ view WRITE setView)
+
+public:
+    NavigatorWidget();
+
+    ::view::GraphicsWidget* view() const;
+
+    QSize sizeHint() const override;
+
+public slots:
+    void setView(::view::GraphicsWidget* view);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+
+private slots:
+    void imageChanged(const QRect& rect);
+
+private:
+    /**
+     * \brief Rebuilds the buffer to fit the widget size
+     */
+    void resetThumbnail();
+    /**
+     * \brief Renders the changed areas to the buffer
+     */
+    void flush();
+    /**
+     * \brief Position of the buffer within the widget
+     */
+    QRect thumbnailRect() const;
+    void moveView(const QPoint& pos);
+
+    QPointer< ::view::GraphicsWidget> view_;
+    ::view::RenderCache* cache = nullptr;
+    QList<QMetaObject::Connection> connections;
+
+    QImage thumbnail;
+    QSize  image_size;
+    qreal  scale = 1;
+    QRegion dirty;
+};
+
+#endif // PIXEL_CAYMAN_NAVIGATOR_WIDGET_HPP
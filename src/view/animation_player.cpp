@@ -0,0 +1,503 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "animation_player.hpp"
+
+#include <QStack>
+#include <QThread>
+#include <QtConcurrent>
+#include "document/visitor.hpp"
+
+namespace view {
+
+AnimationPlayer::AnimationPlayer(::document::Document* document, QObject* parent)
+    : QObject(parent), document_(document)
+{
+    // Edits are coalesced, strokes emit imageEdited for every mouse move
+    update_timer.setSingleShot(true);
+    update_timer.setInterval(0);
+    connect(&update_timer, &QTimer::timeout, this, &AnimationPlayer::updateFrames);
+
+    tick_timer.setSingleShot(true);
+    tick_timer.setTimerType(Qt::PreciseTimer);
+    connect(&tick_timer, &QTimer::timeout, this, &AnimationPlayer::tick);
+
+    connect(document, &::document::Document::edited,
+            this, &AnimationPlayer::scheduleUpdate);
+    connect(document, &::document::Document::imageSizeChanged,
+            this, &AnimationPlayer::scheduleUpdate);
+    // Strokes are picked up once they end, when the image stops painting
+    connect(document, &::document::Document::imageEdited, this,
+            [this](::document::Image* image) {
+                if ( !image->isPainting() )
+                    scheduleUpdate();
+            });
+}
+
+AnimationPlayer::~AnimationPlayer()
+{
+    for ( const Job& job : jobs )
+        job.watcher->waitForFinished();
+}
+
+::document::Document* AnimationPlayer::document() const
+{
+    return document_;
+}
+
+::document::Animation* AnimationPlayer::animation() const
+{
+    return animation_;
+}
+
+void AnimationPlayer::setAnimation(::document::Animation* animation)
+{
+    if ( animation == animation_ )
+        return;
+
+    pause();
+    if ( animation_ )
+        disconnect(animation_, nullptr, this, nullptr);
+
+    animation_ = animation;
+    if ( animation_ )
+        connect(animation_, &QObject::destroyed, this, [this]{ setAnimation(nullptr); });
+
+    ring.clear();
+    frames.clear();
+    if ( active_ )
+        updateFrames();
+    else
+        outdated = true;
+    setFrame(0);
+}
+
+int AnimationPlayer::frame() const
+{
+    return frame_;
+}
+
+bool AnimationPlayer::playing() const
+{
+    return playing_;
+}
+
+bool AnimationPlayer::loop() const
+{
+    return loop_;
+}
+
+void AnimationPlayer::setLoop(bool loop)
+{
+    loop_ = loop;
+}
+
+int AnimationPlayer::cacheSize() const
+{
+    return cache_size;
+}
+
+void AnimationPlayer::setCacheSize(int frames)
+{
+    cache_size = qMax(1, frames);
+    resizeRing();
+    requestFrames();
+}
+
+bool AnimationPlayer::active() const
+{
+    return active_;
+}
+
+void AnimationPlayer::setActive(bool active)
+{
+    active_ = active;
+    if ( active_ && outdated )
+        update_timer.start();
+}
+
+void AnimationPlayer::scheduleUpdate()
+{
+    if ( active_ || playing_ )
+        update_timer.start();
+    else
+        outdated = true;
+}
+
+QImage AnimationPlayer::image() const
+{
+    if ( const Slot* slot = ready(frame_) )
+        return slot->image;
+    return QImage();
+}
+
+void AnimationPlayer::play()
+{
+    if ( outdated && !playing_ )
+        updateFrames();
+
+    if ( playing_ || frames.isEmpty() )
+        return;
+
+    if ( !loop_ && frame_ == frames.size() - 1 )
+        setFrame(0);
+
+    emit playingChanged(playing_ = true);
+    restartClock();
+    scheduleTick();
+}
+
+void AnimationPlayer::pause()
+{
+    if ( !playing_ )
+        return;
+
+    tick_timer.stop();
+    stalled = false;
+    emit playingChanged(playing_ = false);
+}
+
+void AnimationPlayer::stop()
+{
+    pause();
+    setFrame(0);
+}
+
+void AnimationPlayer::setPlaying(bool playing)
+{
+    if ( playing )
+        play();
+    else
+        pause();
+}
+
+void AnimationPlayer::setFrame(int frame)
+{
+    if ( frames.isEmpty() )
+        frame = 0;
+    else
+        frame = qBound(0, frame, frames.size() - 1);
+
+    if ( frame == frame_ )
+        return;
+
+    showFrame(frame);
+    if ( playing_ )
+    {
+        restartClock();
+        scheduleTick();
+    }
+}
+
+void AnimationPlayer::showFrame(int frame)
+{
+    emit frameChanged(frame_ = frame);
+
+    requestFrames();
+
+    if ( const Slot* slot = ready(frame_) )
+        emit imageChanged(slot->image);
+}
+
+void AnimationPlayer::updateFrames()
+{
+    outdated = false;
+    update_timer.stop();
+    QVector<FrameData> data(animation_ ? animation_->count() : 0);
+
+    if ( !data.isEmpty() )
+    {
+        // Lists the images of all the frames in a single pass,
+        // keeping the same opacity and blending as visitor::Paint
+        class Gather : public ::document::Visitor
+        {
+        public:
+            Gather(::document::Animation* animation, QVector<FrameData>& data)
+                : data(data)
+            {
+                for ( int i = 0; i < animation->count(); i++ )
+                    index[animation->frame(i)] = i;
+            }
+
+            bool enter(::document::Document& document) override
+            {
+                opacity.push(1);
+                return true;
+            }
+
+            bool enter(::document::Layer& layer) override
+            {
+                if ( !layer.visible() )
+                    return false;
+                opacity.push(opacity.top() * layer.opacity());
+                mode = layer.blendMode();
+                return true;
+            }
+
+            void leave(::document::Layer& layer) override
+            {
+                opacity.pop();
+            }
+
+            void visit(::document::Image& image) override
+            {
+                auto iter = index.find(image.frame());
+                if ( iter != index.end() )
+                    data[*iter].push_back({image.image(), image.revision(), opacity.top(), mode});
+            }
+
+        private:
+            QVector<FrameData>& data;
+            QHash<const ::document::Frame*, int> index;
+            QStack<qreal> opacity;
+            QPainter::CompositionMode mode = QPainter::CompositionMode_SourceOver;
+        };
+
+        ::document::visitor::LoadImages loader;
+        document_->apply(loader);
+        Gather gather(animation_, data);
+        document_->apply(gather);
+    }
+
+    if ( document_->imageSize() != image_size )
+    {
+        image_size = document_->imageSize();
+        ring.clear();
+    }
+
+    frames = data;
+    resizeRing();
+
+    // Only frames whose contents have changed are discarded
+    bool current_changed = false;
+    for ( Slot& slot : ring )
+    {
+        if ( slot.frame != -1 && (slot.frame >= frames.size() || !(slot.data == frames[slot.frame])) )
+        {
+            current_changed = current_changed || slot.frame == frame_;
+            slot = Slot();
+        }
+    }
+
+    if ( frame_ >= frames.size() && !frames.isEmpty() )
+        showFrame(frames.size() - 1);
+    else
+        requestFrames();
+
+    if ( frames.isEmpty() )
+        pause();
+    else if ( current_changed )
+        emit imageChanged(QImage());
+}
+
+void AnimationPlayer::resizeRing()
+{
+    // Upper bound for the memory used by the cache
+    const qint64 budget = qint64(512) << 20;
+    qint64 frame_bytes = qMax(qint64(1), qint64(image_size.width()) * image_size.height() * 4);
+    int size = qMin(qMin(cache_size, frames.size()), int(qMax(qint64(2), budget / frame_bytes)));
+
+    if ( size == ring.size() )
+        return;
+
+    QVector<Slot> old = ring;
+    ring = QVector<Slot>(size);
+    int used = 0;
+    for ( const Slot& slot : old )
+        if ( used < size && slot.frame != -1 && slot.frame < frames.size() && inWindow(slot.frame) )
+            ring[used++] = slot;
+}
+
+bool AnimationPlayer::inWindow(int frame) const
+{
+    if ( frames.isEmpty() )
+        return false;
+    return (frame - frame_ + frames.size()) % frames.size() < ring.size();
+}
+
+const AnimationPlayer::Slot* AnimationPlayer::ready(int frame) const
+{
+    for ( const Slot& slot : ring )
+        if ( slot.frame == frame )
+            return &slot;
+    return nullptr;
+}
+
+AnimationPlayer::Slot* AnimationPlayer::slotFor(int frame)
+{
+    // The window is never larger than the ring so there is always
+    // a slot which is unused or holds a frame outside of the window
+    Slot* free_slot = nullptr;
+    for ( Slot& slot : ring )
+    {
+        if ( slot.frame == frame )
+            return &slot;
+        if ( !free_slot && (slot.frame == -1 || !inWindow(slot.frame)) )
+            free_slot = &slot;
+    }
+    return free_slot;
+}
+
+void AnimationPlayer::requestFrames()
+{
+    if ( frames.isEmpty() || ring.isEmpty() )
+        return;
+
+    int max_jobs = qMax(1, QThread::idealThreadCount());
+    for ( int i = 0; i < ring.size() && jobs.size() < max_jobs; i++ )
+    {
+        int frame = (frame_ + i) % frames.size();
+        if ( ready(frame) )
+            continue;
+
+        bool pending = false;
+        for ( const Job& job : jobs )
+        {
+            if ( job.frame == frame && job.data == frames[frame] )
+            {
+                pending = true;
+                break;
+            }
+        }
+        if ( pending )
+            continue;
+
+        auto watcher = new QFutureWatcher<QImage>(this);
+        connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher]{
+            jobFinished(watcher);
+        });
+        jobs.push_back({frame, frames[frame], watcher});
+
+        QSize size = image_size;
+        FrameData data = frames[frame];
+        watcher->setFuture(QtConcurrent::run([size, data]{ return render(size, data); }));
+    }
+}
+
+void AnimationPlayer::jobFinished(QFutureWatcher<QImage>* watcher)
+{
+    for ( int i = 0; i < jobs.size(); i++ )
+    {
+        if ( jobs[i].watcher != watcher )
+            continue;
+
+        Job job = jobs.takeAt(i);
+        watcher->deleteLater();
+
+        // Discard results made stale while rendering
+        if ( job.frame < frames.size() && job.data == frames[job.frame] &&
+             inWindow(job.frame) && watcher->result().size() == image_size )
+        {
+            if ( Slot* slot = slotFor(job.frame) )
+            {
+                slot->frame = job.frame;
+                slot->data = job.data;
+                slot->image = watcher->result();
+
+                if ( job.frame == frame_ )
+                    emit imageChanged(watcher->result());
+            }
+        }
+        break;
+    }
+
+    if ( stalled && ready((frame_ + 1) % qMax(1, frames.size())) )
+    {
+        stalled = false;
+        tick();
+    }
+    else
+    {
+        requestFrames();
+    }
+}
+
+QImage AnimationPlayer::render(const QSize& size, const FrameData& data)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    for ( const Draw& draw : data )
+    {
+        painter.setCompositionMode(draw.mode);
+        painter.setOpacity(draw.opacity);
+        painter.drawImage(0, 0, draw.image);
+    }
+    return image;
+}
+
+void AnimationPlayer::restartClock()
+{
+    clock.start();
+    ticks = 0;
+    stalled = false;
+}
+
+void AnimationPlayer::scheduleTick()
+{
+    // Due times are computed from the start of the clock so the
+    // timer inaccuracies don't accumulate
+    int fps = qMax(1, animation_ ? animation_->framesPerSecond() : 1);
+    qint64 due = (ticks + 1) * 1000000000 / fps;
+    qint64 wait = (due - clock.nsecsElapsed()) / 1000000;
+    tick_timer.start(int(qMax(qint64(0), wait)));
+}
+
+void AnimationPlayer::tick()
+{
+    if ( !playing_ || frames.isEmpty() )
+        return;
+
+    int next = frame_ + 1;
+    if ( next >= frames.size() )
+    {
+        if ( !loop_ )
+        {
+            pause();
+            emit finished();
+            return;
+        }
+        next = 0;
+    }
+
+    // Wait for the frame instead of skipping it, jobFinished() resumes
+    if ( !ready(next) )
+    {
+        stalled = true;
+        requestFrames();
+        return;
+    }
+
+    showFrame(next);
+    ticks++;
+
+    // After a stall, or if the event loop has been busy, playback
+    // resumes from here rather than rushing through the late frames
+    int fps = qMax(1, animation_ ? animation_->framesPerSecond() : 1);
+    qint64 period = 1000000000 / fps;
+    if ( clock.nsecsElapsed() - ticks * period > period )
+        restartClock();
+
+    scheduleTick();
+}
+
+} // namespace view
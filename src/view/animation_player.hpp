@@ -0,0 +1,221 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_VIEW_ANIMATION_PLAYER_HPP
+#define PIXEL_CAYMAN_VIEW_ANIMATION_PLAYER_HPP
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QPainter>
+#include <QTimer>
+#include <QVector>
+#include "document/document.hpp"
+
+namespace view {
+
+/**
+ * \brief Plays back an animation from pre-rendered frames
+ *
+ * Frames ahead of the current one are composited in background threads
+ * into a fixed size cache. A cached frame is only discarded when one of the
+ * images it shows, or the layers they belong to, change.
+ *
+ * Playback follows a monotonic clock, if a frame isn't ready when it's due
+ * the player waits for it rather than skipping it.
+ */
+class AnimationPlayer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int frame READ frame WRITE setFrame NOTIFY frameChanged)
+    Q_PROPERTY(bool playing READ playing WRITE setPlaying NOTIFY playingChanged)
+    Q_PROPERTY(bool loop READ loop WRITE setLoop)
+    Q_PROPERTY(int cacheSize READ cacheSize WRITE setCacheSize)
+    Q_PROPERTY(bool active READ active WRITE setActive)
+
+public:
+    explicit AnimationPlayer(::document::Document* document, QObject* parent = nullptr);
+    ~AnimationPlayer();
+
+    ::document::Document* document() const;
+
+    ::document::Animation* animation() const;
+    void setAnimation(::document::Animation* animation);
+
+    /**
+     * \brief Index of the frame being shown
+     */
+    int frame() const;
+
+    bool playing() const;
+
+    /**
+     * \brief Whether playback restarts from the first frame after the last
+     */
+    bool loop() const;
+    void setLoop(bool loop);
+
+    /**
+     * \brief Maximum number of frames kept in memory
+     *
+     * The cache is also limited to a fixed amount of memory,
+     * large canvases will keep fewer frames.
+     */
+    int cacheSize() const;
+    void setCacheSize(int frames);
+
+    /**
+     * \brief Whether frames are kept up to date with the document while paused
+     *
+     * Gathering the frames keeps a reference to every image, so an inactive
+     * player only notes that the document has changed and catches up once
+     * it becomes active or starts playing.
+     */
+    bool active() const;
+    void setActive(bool active);
+
+    /**
+     * \brief Composite image of the current frame
+     * \returns A null image if the frame hasn't been rendered yet
+     */
+    QImage image() const;
+
+public slots:
+    void play();
+    void pause();
+    /**
+     * \brief Pauses and goes back to the first frame
+     */
+    void stop();
+    void setPlaying(bool playing);
+    void setFrame(int frame);
+
+signals:
+    void frameChanged(int frame);
+    void playingChanged(bool playing);
+
+    /**
+     * \brief Emitted when image() changes
+     */
+    void imageChanged(const QImage& image);
+
+    /**
+     * \brief Emitted when playback reaches the last frame without looping
+     */
+    void finished();
+
+private slots:
+    /**
+     * \brief Collects what each frame shows and discards stale frames
+     */
+    void updateFrames();
+
+    /**
+     * \brief Advances to the next frame when it's due
+     */
+    void tick();
+
+private:
+    /**
+     * \brief Image drawn as part of a frame
+     *
+     * The pixels are shared with the document image, the revision is used
+     * to detect whether the image has changed
+     */
+    struct Draw
+    {
+        QImage image;
+        quint64 revision;
+        qreal opacity;
+        QPainter::CompositionMode mode;
+
+        bool operator==(const Draw& other) const
+        {
+            return revision == other.revision && opacity == other.opacity &&
+                   mode == other.mode;
+        }
+    };
+
+    using FrameData = QVector<Draw>;
+
+    /**
+     * \brief Rendered frame in the ring buffer
+     */
+    struct Slot
+    {
+        int frame = -1;
+        FrameData data;
+        QImage image;
+    };
+
+    /**
+     * \brief Frame being rendered in a background thread
+     */
+    struct Job
+    {
+        int frame;
+        FrameData data;
+        QFutureWatcher<QImage>* watcher;
+    };
+
+    static QImage render(const QSize& size, const FrameData& data);
+
+    /**
+     * \brief Starts rendering the missing frames ahead of the current one
+     */
+    void requestFrames();
+    void jobFinished(QFutureWatcher<QImage>* watcher);
+    const Slot* ready(int frame) const;
+    /**
+     * \brief Slot where the rendered \p frame should be stored
+     */
+    Slot* slotFor(int frame);
+    bool inWindow(int frame) const;
+    void resizeRing();
+    /**
+     * \brief Updates the frames soon if active or playing,
+     *        otherwise marks them as outdated
+     */
+    void scheduleUpdate();
+    void showFrame(int frame);
+    void restartClock();
+    void scheduleTick();
+
+    ::document::Document* document_;
+    ::document::Animation* animation_ = nullptr;
+    QSize image_size;
+    QVector<FrameData> frames;
+    QVector<Slot> ring;
+    QList<Job> jobs;
+    int cache_size = 32;
+    int frame_ = 0;
+    bool playing_ = false;
+    bool loop_ = true;
+    bool stalled = false;
+    bool active_ = true;
+    bool outdated = false;
+    QTimer update_timer;
+    QTimer tick_timer;
+    QElapsedTimer clock;
+    qint64 ticks = 0;
+};
+
+} // namespace view
+#endif // PIXEL_CAYMAN_VIEW_ANIMATION_PLAYER_HPP
@@ -22,24 +22,60 @@
 #define PIXEL_CAYMAN_VIEW_GRAPHICS_ITEM_HPP
 
 #include <QGraphicsItem>
+#include <QStyleOptionGraphicsItem>
 #include "document/visitor.hpp"
+#include "render_cache.hpp"
 
 namespace view {
 
 /**
  * \brief Class to render a document on a graphics view
- * \todo option for the frame
+ *
+ * When showing an animation frame, the neighbouring frames can be shown
+ * behind it as onion skins. Those are drawn from the tinted composites in
+ * the RenderCache, fading out the further they are from the current frame.
  */
 class GraphicsItem : public QGraphicsObject
 {
     Q_OBJECT
     Q_PROPERTY(bool fullAlpha READ fullAlpha WRITE setFullAlpha NOTIFY fullAlphaChanged)
 
+    /**
+     * \brief Frame being shown, \b nullptr for images not in an animation
+     */
+    Q_PROPERTY(::document::Frame* frame READ frame WRITE setFrame NOTIFY frameChanged)
+
+    /**
+     * \brief Number of previous frames shown as onion skins
+     */
+    Q_PROPERTY(int onionSkinBefore READ onionSkinBefore WRITE setOnionSkinBefore NOTIFY onionSkinChanged)
+
+    /**
+     * \brief Number of following frames shown as onion skins
+     */
+    Q_PROPERTY(int onionSkinAfter READ onionSkinAfter WRITE setOnionSkinAfter NOTIFY onionSkinChanged)
+
+    /**
+     * \brief Opacity of the closest onion skins
+     */
+    Q_PROPERTY(qreal onionSkinOpacity READ onionSkinOpacity WRITE setOnionSkinOpacity NOTIFY onionSkinChanged)
+
+    /**
+     * \brief Tint of the previous frames, its alpha is the tint strength
+     */
+    Q_PROPERTY(QColor onionSkinColorBefore READ onionSkinColorBefore WRITE setOnionSkinColorBefore NOTIFY onionSkinChanged)
+
+    /**
+     * \brief Tint of the following frames, its alpha is the tint strength
+     */
+    Q_PROPERTY(QColor onionSkinColorAfter READ onionSkinColorAfter WRITE setOnionSkinColorAfter NOTIFY onionSkinChanged)
+
 public:
     GraphicsItem( ::document::Document* document )
-        : document_(document)
+        : document_(document), cache_(RenderCache::of(document))
     {
-        connect(document, &::document::Document::edited, this, &GraphicsItem::updateSlot);
+        setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+        connect(cache_, &RenderCache::changed, this, &GraphicsItem::updateRect);
     }
 
     QRectF boundingRect() const override
@@ -47,10 +83,23 @@ public:
         return QRectF(QPointF(), document_->imageSize());
     }
 
-    void paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *) override
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *) override
     {
-        ::document::visitor::Paint renderer(nullptr, painter, full_alpha);
-        document_->apply(renderer);
+        QRect rect = option->exposedRect.toAlignedRect();
+
+        if ( frame_ && frame_->animation() && (onion_before || onion_after) )
+        {
+            qreal opacity = painter->opacity();
+            int number = frame_->frameNumber();
+            // Furthest frames first so the closest ones end up on top
+            for ( int i = onion_before; i > 0; i-- )
+                paintOnionSkin(painter, rect, number - i, i, onion_before, onion_color_before);
+            for ( int i = onion_after; i > 0; i-- )
+                paintOnionSkin(painter, rect, number + i, i, onion_after, onion_color_after);
+            painter->setOpacity(opacity);
+        }
+
+        cache_->paint(painter, rect, frame_, full_alpha);
     }
 
     ::document::Document* document() const
@@ -66,21 +115,128 @@ public:
 	void setFullAlpha(bool fullAlpha)
 	{
 		if ( fullAlpha != full_alpha )
+		{
 			emit fullAlphaChanged(full_alpha = fullAlpha);
+			update();
+		}
 	}
 
+    ::document::Frame* frame() const
+    {
+        return frame_;
+    }
+
+    void setFrame(::document::Frame* frame)
+    {
+        if ( frame != frame_ )
+        {
+            if ( frame_ )
+                disconnect(frame_, nullptr, this, nullptr);
+            if ( frame )
+                connect(frame, &QObject::destroyed, this, [this]{ setFrame(nullptr); });
+            emit frameChanged(frame_ = frame);
+            update();
+        }
+    }
+
+    int onionSkinBefore() const
+    {
+        return onion_before;
+    }
+
+    void setOnionSkinBefore(int count)
+    {
+        setOnionSkin(onion_before, qMax(0, count));
+    }
+
+    int onionSkinAfter() const
+    {
+        return onion_after;
+    }
+
+    void setOnionSkinAfter(int count)
+    {
+        setOnionSkin(onion_after, qMax(0, count));
+    }
+
+    qreal onionSkinOpacity() const
+    {
+        return onion_opacity;
+    }
+
+    void setOnionSkinOpacity(qreal opacity)
+    {
+        setOnionSkin(onion_opacity, qBound<qreal>(0, opacity, 1));
+    }
+
+    QColor onionSkinColorBefore() const
+    {
+        return onion_color_before;
+    }
+
+    void setOnionSkinColorBefore(const QColor& color)
+    {
+        setOnionSkin(onion_color_before, color);
+    }
+
+    QColor onionSkinColorAfter() const
+    {
+        return onion_color_after;
+    }
+
+    void setOnionSkinColorAfter(const QColor& color)
+    {
+        setOnionSkin(onion_color_after, color);
+    }
+
 signals:
 	void fullAlphaChanged(bool fullAlpha);
+    void frameChanged(::document::Frame* frame);
+    void onionSkinChanged();
 
 private slots:
-    void updateSlot()
+    void updateRect(const QRect& rect)
     {
-        update();
+        update(rect);
     }
 
 private:
+    /**
+     * \brief Draws the frame at \p number, \p distance frames away
+     *        from the current one
+     */
+    void paintOnionSkin(QPainter* painter, const QRect& rect, int number,
+                        int distance, int count, const QColor& tint)
+    {
+        ::document::Frame* frame = frame_->animation()->frame(number);
+        if ( !frame )
+            return;
+
+        // Linear falloff, the furthest frame is still visible
+        painter->setOpacity(onion_opacity * (count - distance + 1) / count);
+        cache_->paintTinted(painter, rect, frame, full_alpha, tint);
+    }
+
+    template<class T>
+    void setOnionSkin(T& property, const T& value)
+    {
+        if ( property != value )
+        {
+            property = value;
+            emit onionSkinChanged();
+            update();
+        }
+    }
+
     ::document::Document* document_;
+    RenderCache* cache_;
 	bool full_alpha = true;
+    ::document::Frame* frame_ = nullptr;
+    int onion_before = 0;
+    int onion_after = 0;
+    qreal onion_opacity = 0.5;
+    QColor onion_color_before{255, 0, 0, 128};
+    QColor onion_color_after{0, 0, 255, 128};
 };
 
 } // namespace view
@@ -119,6 +119,7 @@ void GraphicsWidget::setZoomFactor(qreal factor)
     );
     setTransform(new_transform);
     emit zoomFactorChanged(factor);
+    emit viewportChanged();
 }
 
 void GraphicsWidget::zoom(qreal factor)
@@ -139,6 +140,7 @@ void GraphicsWidget::zoom(qreal factor)
     }
 
     emit zoomFactorChanged(zoomFactor());
+    emit viewportChanged();
 }
 
 void GraphicsWidget::fitSceneRect()
@@ -152,6 +154,19 @@ void GraphicsWidget::translate(const QPointF& delta)
 {
     p->document_item->setPos(p->document_item->pos()+delta);
     fitSceneRect();
+    emit viewportChanged();
+}
+
+void GraphicsWidget::centerOnImage(const QPointF& point)
+{
+    QPointF center = mapToScene(viewport()->rect().center());
+    translate(center - p->document_item->mapToScene(point));
+}
+
+QRectF GraphicsWidget::visibleImageRect() const
+{
+    return p->document_item->mapFromScene(
+        mapToScene(viewport()->rect())).boundingRect();
 }
 
 void GraphicsWidget::drawBackground(QPainter* painter, const QRectF & rect)
@@ -255,6 +270,18 @@ void GraphicsWidget::wheelEvent(QWheelEvent *event)
     viewport()->update();
 }
 
+void GraphicsWidget::resizeEvent(QResizeEvent *event)
+{
+    QGraphicsView::resizeEvent(event);
+    emit viewportChanged();
+}
+
+void GraphicsWidget::scrollContentsBy(int dx, int dy)
+{
+    QGraphicsView::scrollContentsBy(dx, dy);
+    emit viewportChanged();
+}
+
 tool::Tool* GraphicsWidget::currentTool() const
 {
     return p->tool;
@@ -298,6 +325,11 @@ void GraphicsWidget::setColor(const QColor& color)
         emit ( p->color = color );
 }
 
+GraphicsItem* GraphicsWidget::documentItem() const
+{
+    return p->document_item;
+}
+
 document::Layer* GraphicsWidget::activeLayer() const
 {
     /// \todo Handle the active layer being removed
@@ -89,21 +89,40 @@ public:
      */
     QPoint mapFromImage(const QPoint& point);
 
+    /**
+     * \brief Area of the image currently visible in the viewport
+     */
+    QRectF visibleImageRect() const;
+
     QColor color() const;
 
     ::document::Layer* activeLayer() const;
     void setActiveLayer(::document::Layer* layer);
 
+    /**
+     * \brief Item rendering the document, it selects the animation frame
+     *        being edited and the onion skins around it
+     */
+    GraphicsItem* documentItem() const;
+
 public slots:
     void setZoomFactor(qreal factor);
     void zoom(qreal factor);
     void translate(const QPointF& delta);
+    /**
+     * \brief Scrolls the view so \p point (in image coordinates) is at its center
+     */
+    void centerOnImage(const QPointF& point);
     void setColor(const QColor& color);
 
 signals:
     void zoomFactorChanged(qreal zoomFactor);
     void colorChanged(const QColor& color);
     void activeLayerChanged(::document::Layer* activeLayer);
+    /**
+     * \brief Emitted when visibleImageRect() might have changed
+     */
+    void viewportChanged();
 
 protected:
     void drawBackground(QPainter * painter, const QRectF & rect) override;
@@ -113,6 +132,8 @@ protected:
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
     void wheelEvent(QWheelEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
 
 private slots:
     void fitSceneRect();
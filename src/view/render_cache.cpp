@@ -0,0 +1,284 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "render_cache.hpp"
+
+#include <QSet>
+
+#include "document/visitor.hpp"
+
+namespace view {
+
+RenderCache* RenderCache::of(::document::Document* document)
+{
+    if ( auto cache = document->findChild<RenderCache*>(QString(), Qt::FindDirectChildrenOnly) )
+        return cache;
+    return new RenderCache(document);
+}
+
+RenderCache::RenderCache(::document::Document* document)
+    : QObject(document), document_(document)
+{
+    connect(document, &::document::Document::edited,
+            this, &RenderCache::invalidate);
+    connect(document, &::document::Document::imageSizeChanged,
+            this, &RenderCache::invalidate);
+    connect(document, &::document::Document::imageEdited, this,
+            [this](::document::Image* image, const QRect& rect) {
+                invalidateRegion(rect, image->frame());
+            });
+}
+
+::document::Document* RenderCache::document() const
+{
+    return document_;
+}
+
+void RenderCache::invalidate()
+{
+    QSet< ::document::Frame*> frames;
+    for ( ::document::Animation* animation : document_->animations() )
+        for ( ::document::Frame* frame : animation->frames() )
+            frames.insert(frame);
+
+    for ( auto iter = composites.begin(); iter != composites.end(); )
+    {
+        if ( iter.key().first && !frames.contains(iter.key().first) )
+        {
+            iter = composites.erase(iter);
+        }
+        else
+        {
+            iter->valid.fill(false);
+            ++iter;
+        }
+    }
+
+    for ( auto iter = tinted_composites.begin(); iter != tinted_composites.end(); )
+    {
+        if ( iter.key().first.first && !frames.contains(iter.key().first.first) )
+        {
+            iter = tinted_composites.erase(iter);
+        }
+        else
+        {
+            iter->valid.fill(false);
+            ++iter;
+        }
+    }
+
+    emit changed(QRect(QPoint(0, 0), document_->imageSize()));
+}
+
+void RenderCache::invalidateRegion(const QRect& rect, ::document::Frame* frame)
+{
+    for ( bool full_alpha : { false, true } )
+    {
+        auto iter = composites.find(qMakePair(frame, full_alpha));
+        if ( iter != composites.end() )
+            clearTiles(*iter, rect);
+    }
+    for ( auto iter = tinted_composites.begin(); iter != tinted_composites.end(); ++iter )
+        if ( iter.key().first.first == frame )
+            clearTiles(*iter, rect);
+    emit changed(rect);
+}
+
+void RenderCache::paint(QPainter* painter, const QRect& rect,
+                        ::document::Frame* frame, bool full_alpha)
+{
+    QRect area = rect.intersected(QRect(QPoint(0, 0), document_->imageSize()));
+    if ( area.isEmpty() )
+        return;
+
+    const QImage& flat = image(frame, full_alpha, area);
+    painter->drawImage(area.topLeft(), flat, area);
+}
+
+const QImage& RenderCache::image(::document::Frame* frame, bool full_alpha,
+                                 const QRect& rect)
+{
+    Composite& comp = composite(frame, full_alpha);
+    refresh(comp, frame, full_alpha, rect.isNull() ? comp.image.rect() : rect);
+    return comp.image;
+}
+
+void RenderCache::paintTinted(QPainter* painter, const QRect& rect,
+                              ::document::Frame* frame, bool full_alpha,
+                              const QColor& tint)
+{
+    QRect area = rect.intersected(QRect(QPoint(0, 0), document_->imageSize()));
+    if ( area.isEmpty() )
+        return;
+
+    // Make sure the frame composite is ready before looking at the tinted one,
+    // it might clear all the composites if the size has changed
+    image(frame, full_alpha, area);
+    Composite& source = composite(frame, full_alpha);
+    Composite& comp = tinted(frame, full_alpha, tint.rgba());
+    comp.used = ++tint_clock;
+
+    int amount = tint.alpha();
+    int tint_red = tint.red();
+    int tint_green = tint.green();
+    int tint_blue = tint.blue();
+    auto mix = [amount](int from, int to, int alpha) {
+        return from + ((to * alpha / 255 - from) * amount) / 255;
+    };
+
+    QRect range = tileRange(area);
+    for ( int y = range.top(); y <= range.bottom(); y++ )
+    {
+        for ( int x = range.left(); x <= range.right(); x++ )
+        {
+            bool& valid = comp.valid[y * tiles.width() + x];
+            if ( valid )
+                continue;
+            valid = true;
+
+            // Both images are premultiplied so the tint is scaled by alpha
+            QRect tile = QRect(x * tile_size, y * tile_size, tile_size, tile_size)
+                .intersected(comp.image.rect());
+            for ( int row = tile.top(); row <= tile.bottom(); row++ )
+            {
+                const QRgb* in = reinterpret_cast<const QRgb*>(source.image.constScanLine(row));
+                QRgb* out = reinterpret_cast<QRgb*>(comp.image.scanLine(row));
+                for ( int col = tile.left(); col <= tile.right(); col++ )
+                {
+                    QRgb pixel = in[col];
+                    int alpha = qAlpha(pixel);
+                    out[col] = qRgba(mix(qRed(pixel), tint_red, alpha),
+                                     mix(qGreen(pixel), tint_green, alpha),
+                                     mix(qBlue(pixel), tint_blue, alpha),
+                                     alpha);
+                }
+            }
+        }
+    }
+
+    painter->drawImage(area.topLeft(), comp.image, area);
+}
+
+RenderCache::Composite& RenderCache::tinted(::document::Frame* frame, bool full_alpha, QRgb tint)
+{
+    auto key = qMakePair(qMakePair(frame, full_alpha), tint);
+    auto iter = tinted_composites.find(key);
+    if ( iter == tinted_composites.end() )
+    {
+        evictTinted();
+        iter = tinted_composites.insert(key, Composite{
+            QImage(image_size, QImage::Format_ARGB32_Premultiplied),
+            QVector<bool>(tiles.width() * tiles.height(), false),
+            0
+        });
+    }
+    return *iter;
+}
+
+void RenderCache::evictTinted()
+{
+    qint64 image_bytes = qMax(qint64(1), qint64(image_size.width()) * image_size.height() * 4);
+    int max_count = qMax(qint64(2), max_tinted_bytes / image_bytes);
+
+    while ( tinted_composites.size() >= max_count )
+    {
+        auto oldest = tinted_composites.begin();
+        for ( auto iter = tinted_composites.begin(); iter != tinted_composites.end(); ++iter )
+            if ( iter->used < oldest->used )
+                oldest = iter;
+        tinted_composites.erase(oldest);
+    }
+}
+
+RenderCache::Composite& RenderCache::composite(::document::Frame* frame, bool full_alpha)
+{
+    QSize size = document_->imageSize();
+    if ( size != image_size )
+    {
+        composites.clear();
+        tinted_composites.clear();
+        image_size = size;
+        tiles = QSize((size.width() + tile_size - 1) / tile_size,
+                      (size.height() + tile_size - 1) / tile_size);
+    }
+
+    auto key = qMakePair(frame, full_alpha);
+    auto iter = composites.find(key);
+    if ( iter == composites.end() )
+    {
+        iter = composites.insert(key, Composite{
+            QImage(size, QImage::Format_ARGB32_Premultiplied),
+            QVector<bool>(tiles.width() * tiles.height(), false)
+        });
+    }
+    return *iter;
+}
+
+QRect RenderCache::tileRange(const QRect& rect) const
+{
+    QRect area = rect.intersected(QRect(0, 0, tiles.width() * tile_size,
+                                              tiles.height() * tile_size));
+    if ( area.isEmpty() )
+        return QRect();
+    return QRect(QPoint(area.left() / tile_size, area.top() / tile_size),
+                 QPoint(area.right() / tile_size, area.bottom() / tile_size));
+}
+
+void RenderCache::clearTiles(Composite& composite, const QRect& rect)
+{
+    QRect range = tileRange(rect);
+    for ( int y = range.top(); y <= range.bottom(); y++ )
+        for ( int x = range.left(); x <= range.right(); x++ )
+            composite.valid[y * tiles.width() + x] = false;
+}
+
+void RenderCache::refresh(Composite& composite, ::document::Frame* frame,
+                          bool full_alpha, const QRect& rect)
+{
+    QRect range = tileRange(rect);
+    QRegion dirty;
+    for ( int y = range.top(); y <= range.bottom(); y++ )
+    {
+        for ( int x = range.left(); x <= range.right(); x++ )
+        {
+            bool& valid = composite.valid[y * tiles.width() + x];
+            if ( !valid )
+            {
+                dirty += QRect(x * tile_size, y * tile_size, tile_size, tile_size);
+                valid = true;
+            }
+        }
+    }
+
+    if ( dirty.isEmpty() )
+        return;
+
+    QPainter painter(&composite.image);
+    painter.setClipRegion(dirty);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.fillRect(dirty.boundingRect(), Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    ::document::visitor::Paint renderer(frame, &painter, full_alpha);
+    document_->apply(renderer);
+}
+
+} // namespace view
@@ -0,0 +1,147 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2015-2016 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXEL_CAYMAN_VIEW_RENDER_CACHE_HPP
+#define PIXEL_CAYMAN_VIEW_RENDER_CACHE_HPP
+
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QVector>
+#include "document/document.hpp"
+
+namespace view {
+
+/**
+ * \brief Flattened rendering of a document, shared by all of its views
+ *
+ * Keeps one composite image per frame and alpha mode, split in tiles.
+ * Edits only invalidate the tiles they touch and those are re-composited
+ * lazily the next time they are requested.
+ */
+class RenderCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * \brief Size (in pixels) of the side of a cache tile
+     */
+    static constexpr int tile_size = 64;
+
+    /**
+     * \brief Memory (in bytes) used by tinted images before the least
+     *        recently used ones are discarded
+     */
+    static constexpr int max_tinted_bytes = 64 * 1024 * 1024;
+
+    /**
+     * \brief Returns the cache for \p document, creating it if needed
+     *
+     * The cache is owned by the document
+     */
+    static RenderCache* of(::document::Document* document);
+
+    ::document::Document* document() const;
+
+    /**
+     * \brief Draws the area \p rect of the given frame on \p painter
+     * \param full_alpha If \b true, ignores layer visibility and opacity
+     */
+    void paint(QPainter* painter, const QRect& rect,
+               ::document::Frame* frame, bool full_alpha);
+
+    /**
+     * \brief Returns the composite image for a frame
+     *
+     * Only the tiles intersecting \p rect are guaranteed to be up to date,
+     * a null rect refreshes the whole image.
+     */
+    const QImage& image(::document::Frame* frame, bool full_alpha,
+                        const QRect& rect = QRect());
+
+    /**
+     * \brief Draws the area \p rect of the given frame tinted with \p tint
+     *
+     * The alpha of \p tint determines how much the colors are replaced.
+     * Tinted images are cached per tile as well, so drawing them takes a
+     * single blend. Only the most recently used ones are kept, up to
+     * max_tinted_bytes.
+     */
+    void paintTinted(QPainter* painter, const QRect& rect,
+                     ::document::Frame* frame, bool full_alpha,
+                     const QColor& tint);
+
+public slots:
+    /**
+     * \brief Marks the whole document as needing to be re-composited
+     *
+     * Composites of frames no longer in the document are discarded
+     */
+    void invalidate();
+
+    /**
+     * \brief Marks \p rect as needing to be re-composited in \p frame
+     */
+    void invalidateRegion(const QRect& rect, ::document::Frame* frame);
+
+signals:
+    /**
+     * \brief Emitted when the rendering of \p rect might have changed
+     */
+    void changed(const QRect& rect);
+
+private:
+    struct Composite
+    {
+        QImage image;
+        QVector<bool> valid;
+        /**
+         * \brief Value of tint_clock when a tinted composite was last drawn
+         */
+        quint64 used;
+    };
+
+    explicit RenderCache(::document::Document* document);
+
+    using Key = QPair< ::document::Frame*, bool>;
+
+    Composite& composite(::document::Frame* frame, bool full_alpha);
+    Composite& tinted(::document::Frame* frame, bool full_alpha, QRgb tint);
+    void refresh(Composite& composite, ::document::Frame* frame,
+                 bool full_alpha, const QRect& rect);
+    QRect tileRange(const QRect& rect) const;
+    void clearTiles(Composite& composite, const QRect& rect);
+    /**
+     * \brief Removes the least recently used tinted composites until there
+     *        is room for one more
+     */
+    void evictTinted();
+
+    ::document::Document* document_;
+    QSize image_size;
+    QSize tiles;
+    QHash<Key, Composite> composites;
+    QHash<QPair<Key, QRgb>, Composite> tinted_composites;
+    quint64 tint_clock = 0;
+};
+
+} // namespace view
+#endif // PIXEL_CAYMAN_VIEW_RENDER_CACHE_HPP
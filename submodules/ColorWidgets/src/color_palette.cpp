@@ -21,14 +21,96 @@
  */
 #include "color_palette.hpp"
 #include <cmath>
+#include <cstring>
 #include <QFile>
-#include <QTextStream>
 #include <QHash>
 #include <QPainter>
 #include <QFileInfo>
 
 namespace color_widgets {
 
+namespace {
+
+/**
+ * \brief Extracts the next line from [\p pos, \p end)
+ *
+ * [\p line, \p line_end) is the line without the terminator
+ */
+inline bool next_line(const char*& pos, const char* end,
+                      const char*& line, const char*& line_end)
+{
+    if ( pos >= end )
+        return false;
+
+    line = pos;
+    const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+    line_end = newline ? newline : end;
+    pos = newline ? newline + 1 : end;
+    if ( line_end > line && line_end[-1] == '\r' )
+        --line_end;
+    return true;
+}
+
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline const char* skip_space(const char* pos, const char* end)
+{
+    while ( pos < end && is_space(*pos) )
+        ++pos;
+    return pos;
+}
+
+/**
+ * \brief Parses an unsigned integer, advancing \p pos past it
+ */
+inline bool parse_int(const char*& pos, const char* end, int& value)
+{
+    pos = skip_space(pos, end);
+    const char* start = pos;
+    value = 0;
+    for ( ; pos < end && is_digit(*pos); ++pos )
+        if ( value < 0x10000 )
+            value = value * 10 + (*pos - '0');
+    return pos != start;
+}
+
+/**
+ * \brief UTF-8 string from [\p begin, \p end) without surrounding spaces
+ */
+inline QString trimmed(const char* begin, const char* end)
+{
+    begin = skip_space(begin, end);
+    while ( end > begin && is_space(end[-1]) )
+        --end;
+    return QString::fromUtf8(begin, end - begin);
+}
+
+/**
+ * \brief Appends \p value right-aligned on 3 characters
+ */
+inline void append_padded(QByteArray& data, int value)
+{
+    char digits[4] = {' ', ' ', ' ', '\0'};
+    int i = 2;
+    do
+    {
+        digits[i--] = '0' + value % 10;
+        value /= 10;
+    }
+    while ( value > 0 && i >= 0 );
+    data.append(digits, 3);
+}
+
+} // namespace
+
 class ColorPalette::Private
 {
 public:
@@ -193,62 +275,86 @@ bool ColorPalette::load(const QString& name)
 
     QFile file(name);
 
-    if ( !file.open(QFile::ReadOnly|QFile::Text) )
+    if ( !file.open(QFile::ReadOnly) )
     {
         emitUpdate();
         return false;
     }
 
-    QTextStream stream( &file );
+    // Parse straight from the mapped file when possible
+    QByteArray buffer;
+    const char* pos = nullptr;
+    qint64 size = file.size();
+    if ( uchar* mapped = size > 0 ? file.map(0, size) : nullptr )
+    {
+        pos = reinterpret_cast<const char*>(mapped);
+    }
+    else
+    {
+        buffer = file.readAll();
+        pos = buffer.constData();
+        size = buffer.size();
+    }
+    const char* end = pos + size;
+    const char* line;
+    const char* line_end;
+
+    if ( size >= 3 && std::memcmp(pos, "\xEF\xBB\xBF", 3) == 0 )
+        pos += 3;
 
-    if ( stream.readLine() != "GIMP Palette" )
+    static const char header[] = "GIMP Palette";
+    if ( !next_line(pos, end, line, line_end) ||
+         line_end - line != int(sizeof(header)) - 1 ||
+         std::memcmp(line, header, sizeof(header) - 1) != 0 )
     {
         emitUpdate();
         return false;
     }
 
-    QString line;
-
-    // parse properties
     QHash<QString,QString> properties;
-    while( !stream.atEnd() )
+    QVector<QPair<QColor,QString> > colors;
+    colors.reserve(size / 16);
+    bool in_header = true;
+
+    while ( next_line(pos, end, line, line_end) )
     {
-        line = stream.readLine();
-        if ( line.isEmpty() )
+        const char* cursor = skip_space(line, line_end);
+        if ( cursor == line_end )
             continue;
-        if ( line[0] == '#' )
-            break;
-        int colon = line.indexOf(':');
-        if ( colon == -1 )
-            break;
-        properties[line.left(colon).toLower()] =
-            line.right(line.size() - colon - 1).trimmed();
-    }
-    /// \todo Store extra properties in the palette object
-    setName(properties["name"]);
-    setColumns(properties["columns"].toInt());
 
-    // Skip comments
-    if ( !stream.atEnd() && line[0] == '#' )
-        while( !stream.atEnd() )
+        // Comments end the properties
+        if ( *cursor == '#' )
+        {
+            in_header = false;
+            continue;
+        }
+
+        if ( in_header )
         {
-            qint64 pos = stream.pos();
-            line = stream.readLine();
-            if ( !line.isEmpty() && line[0] != '#' )
+            const char* colon = static_cast<const char*>(
+                std::memchr(cursor, ':', line_end - cursor));
+            if ( colon && !is_digit(*cursor) )
             {
-                stream.seek(pos);
-                break;
+                properties[trimmed(cursor, colon).toLower()] =
+                    trimmed(colon + 1, line_end);
+                continue;
             }
+            in_header = false;
         }
 
-    while( !stream.atEnd() )
-    {
-        int r = 0, g = 0, b = 0;
-        stream >> r >> g >> b;
-        line = stream.readLine().trimmed();
-        p->colors.push_back(qMakePair(QColor(r, g, b), line));
+        int r, g, b;
+        if ( !parse_int(cursor, line_end, r) ||
+             !parse_int(cursor, line_end, g) ||
+             !parse_int(cursor, line_end, b) )
+            continue;
+        colors.push_back(qMakePair(QColor(r, g, b), trimmed(cursor, line_end)));
     }
 
+    /// \todo Store extra properties in the palette object
+    setName(properties["name"]);
+    setColumns(properties["columns"].toInt());
+
+    p->colors = colors;
     Q_EMIT colorsChanged(p->colors);
     setDirty(false);
 
@@ -277,27 +383,32 @@ bool ColorPalette::save()
     }
 
     QFile file(filename);
-    if ( !file.open(QFile::Text|QFile::WriteOnly) )
+    if ( !file.open(QFile::WriteOnly) )
         return false;
 
-    QTextStream stream(&file);
+    QByteArray data;
+    data.reserve(64 + p->colors.size() * 24);
 
-    stream << "GIMP Palette\n";
-    stream << "Name: " << unnamed(p->name) << '\n';
+    data += "GIMP Palette\n";
+    data += "Name: " + unnamed(p->name).toUtf8() + '\n';
     if ( p->columns )
-        stream << "Columns: " << p->columns << '\n';
+        data += "Columns: " + QByteArray::number(p->columns) + '\n';
     /// \todo Options to add comments
-    stream << "#\n";
+    data += "#\n";
 
-    for ( int i = 0; i < p->colors.size(); i++ )
+    for ( const auto& color : p->colors )
     {
-        stream << qSetFieldWidth(3) << p->colors[i].first.red() << qSetFieldWidth(0) << ' '
-               << qSetFieldWidth(3) << p->colors[i].first.green() << qSetFieldWidth(0) << ' '
-               << qSetFieldWidth(3) << p->colors[i].first.blue() << qSetFieldWidth(0) << '\t'
-               << unnamed(p->colors[i].second) << '\n';
+        append_padded(data, color.first.red());
+        data += ' ';
+        append_padded(data, color.first.green());
+        data += ' ';
+        append_padded(data, color.first.blue());
+        data += '\t';
+        data += unnamed(color.second).toUtf8();
+        data += '\n';
     }
 
-    if ( !file.error() )
+    if ( file.write(data) == data.size() && file.flush() )
     {
         setDirty(false);
         return true;